@@ -30,6 +30,18 @@ static inline void local_flush_tlb_page(unsigned long addr)
     __asm__ __volatile__ ("sfence.vma %0" : : "r" (addr) : "memory");
 }
 
+/* Flush all non-global entries of `asid` from local TLB */
+static inline void local_flush_tlb_asid(unsigned long asid)
+{
+    __asm__ __volatile__ ("sfence.vma zero, %0" : : "r" (asid) : "memory");
+}
+
+/* Flush one page of `asid` from local TLB */
+static inline void local_flush_tlb_page_asid(unsigned long addr, unsigned long asid)
+{
+    __asm__ __volatile__ ("sfence.vma %0, %1" : : "r" (addr), "r" (asid) : "memory");
+}
+
 static inline void local_flush_icache_all(void)
 {
     asm volatile ("fence.i" ::: "memory");
@@ -43,6 +55,15 @@ static inline void set_satp(
     __asm__ __volatile__("sfence.vma\ncsrw satp, %0" : : "rK"(__v) : "memory");
 }
 
+/* like set_satp, but the TLB entries of `asid` are kept */
+static inline void switch_satp(
+    unsigned mode, unsigned asid, unsigned long ppn)
+{
+    unsigned long __v =
+        (unsigned long)(((unsigned long)mode << SATP_MODE_SHIFT) | ((unsigned long)asid << SATP_ASID_SHIFT) | ppn);
+    __asm__ __volatile__("csrw satp, %0" : : "rK"(__v) : "memory");
+}
+
 #define PGDIR_PA 0x51000000lu  // use 51000000 page as PGDIR
 #define PGDIR_VA 0xffffffc051000000
 #define KERNEL_VM_OFFSET 0xffffffc000000000
@@ -4,6 +4,7 @@
 #include <os/sched.h>
 #include <os/irq.h>
 #include <os/kernel.h>
+#include <os/lock.h>
 
 #define SCREEN_WIDTH    80
 #define SCREEN_HEIGHT   50
@@ -13,6 +14,11 @@
 char new_screen[SCREEN_HEIGHT * SCREEN_WIDTH] = {0};
 char old_screen[SCREEN_HEIGHT * SCREEN_WIDTH] = {0};
 
+/* screen buffers and the serial port, taken in the public functions */
+spin_lock_t screen_lock;
+
+static void __screen_reflush(void);
+
 /* cursor position */
 static void vt100_move_cursor(int x, int y)
 {
@@ -59,6 +65,7 @@ void init_screen(void)
 void screen_clear(void)
 {
     int i, j;
+    spin_lock_acquire(&screen_lock);
     for (i = 0; i < SCREEN_HEIGHT; i++)
     {
         for (j = 0; j < SCREEN_WIDTH; j++)
@@ -68,14 +75,17 @@ void screen_clear(void)
     }
     current_running->cursor_x = 0;
     current_running->cursor_y = 0;
-    screen_reflush();
+    __screen_reflush();
+    spin_lock_release(&screen_lock);
 }
 
 void screen_move_cursor(int x, int y)
 {
+    spin_lock_acquire(&screen_lock);
     current_running->cursor_x = x;
     current_running->cursor_y = y;
     vt100_move_cursor(x, y);
+    spin_lock_release(&screen_lock);
 }
 
 void screen_write(char *buff)
@@ -83,10 +93,12 @@ void screen_write(char *buff)
     int i = 0;
     int l = strlen(buff);
 
+    spin_lock_acquire(&screen_lock);
     for (i = 0; i < l; i++)
     {
         screen_write_ch(buff[i]);
     }
+    spin_lock_release(&screen_lock);
 }
 
 /*
@@ -96,6 +108,13 @@ void screen_write(char *buff)
  * the characters that have been modified since this time.
  */
 void screen_reflush(void)
+{
+    spin_lock_acquire(&screen_lock);
+    __screen_reflush();
+    spin_lock_release(&screen_lock);
+}
+
+static void __screen_reflush(void)
 {
     int i, j;
 
@@ -119,7 +138,9 @@ void screen_reflush(void)
 }
 
 void screen_backspace(int prompt_len) {
+    spin_lock_acquire(&screen_lock);
     if (current_running->cursor_x > prompt_len) {
         new_screen[SCREEN_LOC(--current_running->cursor_x, current_running->cursor_y)] = ' '; 
     }
+    spin_lock_release(&screen_lock);
 }
\ No newline at end of file
@@ -0,0 +1,64 @@
+#ifndef INCLUDE_HANDLE_H_
+#define INCLUDE_HANDLE_H_
+
+#include <type.h>
+#include <os/list.h>
+#include <os/mm.h>
+
+/* handle tables of the sync objects, see handle.c. an object starts with
+   a handle_obj_t, is found by the hash of its key (or name) and by its
+   handle, the index the user passes to the syscalls */
+
+#define HANDLE_HASH_BITS 8
+#define HANDLE_HASH_SIZE (1 << HANDLE_HASH_BITS)
+
+/* handles per page of the table, and pages in the directory */
+#define HANDLES_PER_PAGE (PAGE_SIZE / sizeof(uintptr_t))
+#define MAX_HANDLES      (HANDLES_PER_PAGE * HANDLES_PER_PAGE)
+
+/* a handle is the index of its slot and the generation of the slot,
+   bumped each time the slot is freed, so a stale handle does not
+   reach the next object put in the slot */
+#define HANDLE_INDEX_BITS 18        /* log2(MAX_HANDLES) */
+#define HANDLE_INDEX_MASK ((1 << HANDLE_INDEX_BITS) - 1)
+#define HANDLE_GEN_MASK   ((1 << (31 - HANDLE_INDEX_BITS)) - 1)
+
+typedef struct handle_obj
+{
+    list_node_t hash_node;
+    uint32_t hash;              /* the key, or the hash of the name */
+    int handle;
+    int ref;
+} handle_obj_t;
+
+typedef struct handle_table
+{
+    slab_cache_t cache;
+    list_head buckets[HANDLE_HASH_SIZE];
+
+    /* a page of pointers to pages of slots, allocated as slots are
+       handed out. a free slot holds its generation << 32 and the index
+       of the next free slot + 1, << 1 | 1 */
+    uintptr_t **dir;
+    int nr_handles;             /* slots ever handed out */
+    int free_handle;            /* index of the first free slot, -1 for none */
+    int nr_objs;
+} handle_table_t;
+
+void handle_table_init(handle_table_t *table, uint32_t obj_size);
+list_head *handle_bucket(handle_table_t *table, uint32_t hash);
+handle_obj_t *handle_find(handle_table_t *table, uint32_t hash);
+handle_obj_t *handle_open(handle_table_t *table, uint32_t hash, int *created);
+handle_obj_t *handle_alloc(handle_table_t *table, uint32_t hash);
+void handle_free(handle_table_t *table, handle_obj_t *obj);
+handle_obj_t *handle_get(handle_table_t *table, int handle);
+
+/* walk all objects of `table`, they must not be freed meanwhile */
+#define handle_for_each(obj, table, bucket, node) \
+    for (bucket = 0; bucket < HANDLE_HASH_SIZE; bucket++) \
+        for (node = (table)->buckets[bucket].next; \
+             node != &(table)->buckets[bucket] && \
+             ((obj) = list_entry_of(node, handle_obj_t, hash_node), 1); \
+             node = node->next)
+
+#endif
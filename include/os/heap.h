@@ -0,0 +1,54 @@
+#ifndef INCLUDE_HEAP_H_
+#define INCLUDE_HEAP_H_
+
+#include <type.h>
+#include <os/list.h>
+
+// binary min-heap of intrusive nodes
+// the node is embedded in the owner, just like list_node_t
+typedef struct heap_node
+{
+    uint64_t key;
+    int index;          // slot in `nodes`, -1 when not in a heap
+} heap_node_t;
+
+// the node pointers are kept in kalloc pages, which are found through
+// one more page of page pointers. pages are allocated as the heap grows
+// and kept once allocated
+#define HEAP_PAGE_NODES 512
+#define HEAP_MAX_NODES  (HEAP_PAGE_NODES * HEAP_PAGE_NODES)
+
+typedef struct heap
+{
+    heap_node_t ***pages;   // NULL until the first push
+    int size;
+    int capacity;           // nodes in the allocated pages
+} heap_t;
+
+#define heap_entry(ptr, type, member) \
+    ((type *)((char *)(ptr) - offsetof(type, member)))
+
+static inline void heap_node_init(heap_node_t *node) {
+    node->index = -1;
+}
+
+static inline int heap_node_queued(heap_node_t *node) {
+    return node->index >= 0;
+}
+
+static inline int is_heap_empty(heap_t *heap) {
+    return heap->size == 0;
+}
+
+// node with the smallest key, NULL when the heap is empty
+static inline heap_node_t *heap_peek(heap_t *heap) {
+    return heap->size == 0 ? NULL : heap->pages[0][0];
+}
+
+void heap_init(heap_t *heap);
+int heap_push(heap_t *heap, heap_node_t *node);
+heap_node_t *heap_pop(heap_t *heap);
+void heap_remove(heap_t *heap, heap_node_t *node);
+void heap_update(heap_t *heap, heap_node_t *node, uint64_t key);
+
+#endif
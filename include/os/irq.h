@@ -74,6 +74,7 @@ extern void init_exception();
 extern void setup_exception();
 
 extern void handle_irq_timer(regs_context_t *regs, uint64_t stval, uint64_t scause);
+extern void handle_irq_soft(regs_context_t *regs, uint64_t stval, uint64_t scause);
 extern void handle_irq_ext(regs_context_t *regs, uint64_t stval, uint64_t scause);
 extern void handle_other(regs_context_t *regs, uint64_t stval, uint64_t scause);
 extern void handle_syscall(regs_context_t *regs, uint64_t stval, uint64_t scause);
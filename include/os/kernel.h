@@ -4,6 +4,7 @@
 #include <type.h>
 #include <common.h>
 #include <pgtable.h>
+#include <os/lock.h>
 
 #define KERNEL_JMPTAB_BASE 0xffffffc051ffff00
 typedef enum {
@@ -51,15 +52,21 @@ static inline int bios_getchar(void)
 static inline int bios_sdread(unsigned mem_address, unsigned num_of_blocks, \
                               unsigned block_id)
 {
-    return call_jmptab(SD_READ, (long)mem_address, (long)num_of_blocks, \
+    spin_lock_acquire(&sd_lock);
+    int ret = call_jmptab(SD_READ, (long)mem_address, (long)num_of_blocks, \
                         (long)block_id);
+    spin_lock_release(&sd_lock);
+    return ret;
 }
 
 static inline int bios_sdwrite(unsigned mem_address, unsigned num_of_blocks, \
                               unsigned block_id)
 {
-    return call_jmptab(SD_WRITE, (long)mem_address, (long)num_of_blocks, \
+    spin_lock_acquire(&sd_lock);
+    int ret = call_jmptab(SD_WRITE, (long)mem_address, (long)num_of_blocks, \
                         (long)block_id);
+    spin_lock_release(&sd_lock);
+    return ret;
 }
 
 static inline void bios_logging(char *str)
@@ -72,6 +72,13 @@ static inline void list_delete_entry(list_node_t *entry) {
     entry->prev->next = entry->next;
 }
 
+// delete `entry` and make it point to itself, so that a later
+// list_delete_entry on it is harmless
+static inline void list_delete_init(list_node_t *entry) {
+    list_delete_entry(entry);
+    INIT_LIST_HEAD(entry);
+}
+
 #define GET_PCB_FROM_LIST(list) (pcb_t *)((ptr_t)list - 2 * sizeof(reg_t) - 2 * sizeof(ptr_t))
 
 /* Offset of member MEMBER in a struct of type TYPE. */
@@ -79,6 +86,10 @@ static inline void list_delete_entry(list_node_t *entry) {
 
 #define list_entry(ptr, type)  (type *)((char *)ptr - offsetof(type, list))
 
+/* like list_entry, for a node other than `list` */
+#define list_entry_of(ptr, type, member) \
+    ((type *)((char *)(ptr) - offsetof(type, member)))
+
 #define list_for_each_entry(pos, head) \
     for (pos = list_entry((head)->next, typeof(*pos)); \
         	&pos->list != (head); \
@@ -29,27 +29,61 @@
 #define INCLUDE_LOCK_H_
 
 #include <os/list.h>
-
-#define LOCK_NUM 16
+#include <os/handle.h>
 
 typedef enum {
     UNLOCKED,
     LOCKED,
 } lock_status_t;
 
+/* ticket lock: a cpu takes the ticket `next` and spins reading `owner`
+   until its turn comes, so the lock is handed out in FIFO order and the
+   waiters do not write the lock word while it is held */
 typedef struct spin_lock
 {
-    volatile lock_status_t status;
+    union {
+        volatile uint32_t val;
+        struct {
+            volatile uint16_t owner;
+            volatile uint16_t next;
+        };
+    };
 } spin_lock_t;
 
+/* MCS lock: each waiter spins on its own node, which the holder before
+   it flags on release. the node (on the stack of the caller) is passed
+   to both acquire and release, so the lock must be released on the cpu
+   that took it */
+typedef struct mcs_node
+{
+    struct mcs_node *volatile next;
+    volatile int locked;
+} mcs_node_t;
+
+typedef struct mcs_lock
+{
+    mcs_node_t *volatile tail;
+} mcs_lock_t;
+
+/* sync objects live in handle tables, see handle.h: the handle is what
+   the init syscall returns, and the object is freed once the last user
+   destroys (or closes) it and nobody holds or waits for it */
 typedef struct mutex_lock
 {
+    handle_obj_t obj;
     spin_lock_t lock;
     list_head block_queue;
-    int key;
     pid_t pid;
+    struct pcb *volatile owner;     /* the thread holding it, read unlocked by spinners */
+    list_node_t owner_node;         /* in pi_mutexes of the owner */
 } mutex_lock_t;
 
+/* a waiter spins this long while the owner runs on another cpu */
+#define MUTEX_SPIN_US 20
+
+/* longest chain of blocked mutex owners a priority boost goes down */
+#define PI_CHAIN_MAX 16
+
 void init_locks(void);
 
 void spin_lock_init(spin_lock_t *lock);
@@ -57,20 +91,47 @@ int spin_lock_try_acquire(spin_lock_t *lock);
 void spin_lock_acquire(spin_lock_t *lock);
 void spin_lock_release(spin_lock_t *lock);
 
+static inline int spin_lock_is_locked(spin_lock_t *lock)
+{
+    uint32_t val = lock->val;
+    return (val & 0xffff) != (val >> 16);
+}
+
+void mcs_lock_init(mcs_lock_t *lock);
+void mcs_lock_acquire(mcs_lock_t *lock, mcs_node_t *node);
+void mcs_lock_release(mcs_lock_t *lock, mcs_node_t *node);
+
+/* subsystem locks, one per kernel subsystem instead of one big kernel
+   lock. a cpu holding one of them only takes locks further down:
+     fs_lock -> ipc_lock -> net_lock -> sched_lock
+       -> mm_lock -> asid_lock -> kalloc_lock
+   screen_lock and sd_lock are leaves taken under any of them */
+extern spin_lock_t fs_lock;         /* file system, its buffers and fds */
+extern spin_lock_t ipc_lock;        /* mutexes, barriers, conditions, mailboxes */
+extern spin_lock_t net_lock;        /* e1000 rings and the net wait queues */
+extern spin_lock_t sched_lock;      /* run queues, pcbs, timers, sleep/wait queues */
+extern spin_lock_t mm_lock;         /* user pages, swap and share pages */
+extern spin_lock_t asid_lock;       /* address space ids */
+extern mcs_lock_t  kalloc_lock;     /* kernel free page list */
+extern spin_lock_t screen_lock;     /* screen buffer and console */
+extern spin_lock_t sd_lock;         /* sd card */
+
 int do_mutex_lock_init(int key);
 void do_mutex_lock_acquire(int mlock_idx);
 void do_mutex_lock_release(int mlock_idx);
+int do_mutex_lock_destroy(int mlock_idx);
+void release_task_mutexes(list_head *owned, pid_t pid, int last_thread);
+void disown_task_mutexes(struct pcb *p, list_head *orphans);
+void cancel_cond_wait(struct pcb *p);
 
 typedef struct barrier
 {
+    handle_obj_t obj;
     int current;
     int goal;
-    int key;
     list_head block_list;
 } barrier_t;
 
-#define BARRIER_NUM 16
-
 void init_barriers(void);
 int do_barrier_init(int key, int goal);
 void do_barrier_wait(int bar_idx);
@@ -78,12 +139,10 @@ void do_barrier_destroy(int bar_idx);
 
 typedef struct condition
 {
-    int key;
+    handle_obj_t obj;
     list_head wait_list;
 } condition_t;
 
-#define CONDITION_NUM 16
-
 void init_conditions(void);
 int do_condition_init(int key);
 void do_condition_wait(int cond_idx, int mutex_idx);
@@ -91,26 +150,78 @@ void do_condition_signal(int cond_idx);
 void do_condition_broadcast(int cond_idx);
 void do_condition_destroy(int cond_idx);
 
+/* default capacity of a mailbox, and the largest one asked for
+   at open, the ring is a single page */
 #define MAX_MBOX_LENGTH (64)
+#define MBOX_MAX_CAPACITY PAGE_SIZE
+
+#define MBOX_NAME_LEN 32
 
+/* hashed by its name, the references are the opens. the ring holds
+   capacity (a power of two) bytes, head and tail run freely and are
+   masked on access, tail - head bytes are in it */
 typedef struct mailbox
 {
-    char name[32];
-    char buf[MAX_MBOX_LENGTH];
-  
-    int mutex_id;
-    int ref;
+    handle_obj_t obj;
+    char name[MBOX_NAME_LEN];
+    char *buf;
+    uint32_t capacity;
+    uint32_t head, tail;
+
+    /* waiters, each with the length it asked for in mbox_want */
     list_head send_list, recv_list;
 
-    int nread, nwrite;
-    int round_read, round_write;
+    /* page messages and the receivers waiting for one */
+    list_head page_msgs;
+    list_head page_waiters;
+    int nr_page_msgs;
 } mailbox_t;
 
-#define MBOX_NUM 16
+/* a message of pages moved from the sender's address space to the
+   receiver's, it takes a kalloc page of its own */
+typedef struct mbox_pages
+{
+    list_node_t list;
+    int npages;
+    struct page *pages[];
+} mbox_pages_t;
+
+#define MBOX_PAGES_MAX ((PAGE_SIZE - sizeof(mbox_pages_t)) / sizeof(struct page *))
+
+/* reader-writer lock: any number of readers or one writer. with
+   RWLOCK_PREFER_WRITER a queued writer holds off new readers, else
+   readers get in whenever no writer holds it */
+#define RWLOCK_PREFER_WRITER 1
+
+typedef struct rwlock
+{
+    handle_obj_t obj;
+    int flags;
+    int readers;            /* readers holding it */
+    pid_t writer;           /* pid of the writer holding it, 0 for none */
+    list_head read_queue;
+    list_head write_queue;
+} rwlock_t;
+
+void init_rwlocks(void);
+int do_rwlock_init(int key, int flags);
+void do_rwlock_rdlock(int rw_idx);
+void do_rwlock_wrlock(int rw_idx);
+void do_rwlock_unlock(int rw_idx);
+int do_rwlock_destroy(int rw_idx);
+
+/* futexes, waits keyed on a user word, see futex.c */
+void init_futex(void);
+int do_futex_wait(int *uaddr, int val);
+int do_futex_wake(int *uaddr, int n);
+void futex_unpin(struct pcb *p);
+
 void init_mbox();
-int do_mbox_open(char *name);
+int do_mbox_open(char *name, int capacity);
 void do_mbox_close(int mbox_idx);
 int do_mbox_send(int mbox_idx, void * msg, int msg_length);
 int do_mbox_recv(int mbox_idx, void * msg, int msg_length);
+int do_mbox_send_pages(int mbox_idx, void *addr, int npages);
+int do_mbox_recv_pages(int mbox_idx, void *addr, int npages);
 
 #endif
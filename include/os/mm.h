@@ -52,6 +52,14 @@ extern void free_pgdir(PTE *pgdir);
 extern PTE *get_pte_of_uva(uint64_t va, PTE *pgdir);
 
 extern void share_pgtable(PTE *dest_pgdir, PTE *src_pgdir);
+
+/* address space ids, see asid.c */
+extern void init_asid(void);
+extern PTE *alloc_pgdir(void);
+extern void switch_mm(PTE *pgdir);
+extern void mm_flush_page(PTE *pgdir, uint64_t uva);
+extern void mm_shootdown_ack(void);
+extern int mm_release(PTE *pgdir);
 extern uintptr_t alloc_page_helper(uintptr_t va, PTE *pgdir);
 
 typedef struct freemem {
@@ -59,6 +67,22 @@ typedef struct freemem {
 } freemem_t;
 extern freemem_t *freemem_list;
 
+/* objects of one size cut from kalloc pages, see slab.c */
+typedef struct slab_obj {
+    struct slab_obj *next;
+} slab_obj_t;
+
+typedef struct slab_cache {
+    uint32_t size;
+    slab_obj_t *free;
+    int nr_used;
+    int nr_free;
+} slab_cache_t;
+
+extern void slab_cache_init(slab_cache_t *cache, uint32_t size);
+extern void *slab_alloc(slab_cache_t *cache);
+extern void slab_free(slab_cache_t *cache, void *obj);
+
 #define MAX_PFN         512
 #define MAX_PRESENT_PFN 512
 typedef struct page {
@@ -71,6 +95,10 @@ typedef struct page {
     // start block id of the page on SD card
     // when this page is swapped out
     int sector_id;       
+
+    // futex waiters sleeping on a word in it, it is not
+    // swapped out (and its kva stays the same) while > 0
+    int pin;
 } page_t;
 
 extern int page_id;
@@ -86,6 +114,15 @@ extern page_t *find_page_with_uva(uint64_t uva, PTE *pgdir, list_head *queue);
 extern page_t *find_page_with_kva(uint64_t kva, list_head *queue);
 extern void free_page_with_uva(uint64_t uva, PTE *pgdir);
 extern void free_page_with_kva(uint64_t kva);
+extern uint64_t page_fault_in(uint64_t uva, PTE *pgdir);
+extern void page_pin(uint64_t kva);
+extern void page_unpin(uint64_t kva);
+
+/* moving a private page between address spaces, see mm.c */
+extern int page_is_movable(uint64_t uva, PTE *pgdir);
+extern page_t *page_detach(uint64_t uva, PTE *pgdir);
+extern void page_attach(page_t *page, uint64_t uva, PTE *pgdir);
+extern void page_drop(page_t *page);
 
 extern void swap_out();
 extern void swap_in(page_t *page);
@@ -12,5 +12,6 @@ int do_net_send(void *txpacket, int length);
 
 void check_net_send();
 void check_net_recv();
+int net_has_waiters(void);
 
 #endif  // !__INCLUDE_NET_H__
\ No newline at end of file
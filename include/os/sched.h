@@ -31,11 +31,56 @@
 
 #include <type.h>
 #include <os/list.h>
+#include <os/lock.h>
 #include <os/smp.h>
+#include <os/time.h>
 #include <pgtable.h>
 
-#define NUM_MAX_TASK 16
-#define NUM_MAX_SUB_THREADS 64
+/* highest limit do_task_limit accepts, a run queue heap holds that many */
+#define NUM_MAX_TASK HEAP_MAX_NODES
+
+/* default limits on tasks and on threads of a process, see do_task_limit */
+#define DEFAULT_MAX_TASKS   64
+#define DEFAULT_MAX_THREADS 64
+
+/* cpu bandwidth groups, their ids are 1..NUM_BW_GROUPS */
+#define NUM_BW_GROUPS 16
+
+/* buckets of the pid and (pid, tid) hash tables */
+#define PID_HASH_SIZE 64
+
+/* a task may run on the cpus whose bit is set in its cpu_mask */
+#define CPU_MASK_ALL ((1u << nr_cpus) - 1)
+
+/* scheduling policies of normal tasks, SCHED_POLICY is the one at
+   boot, do_sched_policy switches to another one at run time */
+#define SCHED_RR    0
+#define SCHED_FAIR  1
+#define SCHED_MLFQ  2
+
+#ifndef SCHED_POLICY
+#define SCHED_POLICY SCHED_FAIR
+#endif
+
+/* nice values and the load weight of a nice-0 task */
+#define NICE_MIN -20
+#define NICE_MAX 19
+#define NICE_0_WEIGHT 1024
+
+/* fair scheduling period and the least time a task runs before preempted */
+#define SCHED_LATENCY           (4 * TIMER_INTERVAL)
+#define SCHED_MIN_GRANULARITY   TIMER_INTERVAL
+#define SCHED_WAKEUP_GRANULARITY TIMER_INTERVAL
+
+/* mlfq: level i has a slice of TIMER_INTERVAL << i,
+   all tasks go back to level 0 every MLFQ_BOOST_INTERVAL */
+#define MLFQ_LEVELS 4
+#define MLFQ_BOOST_INTERVAL (50 * TIMER_INTERVAL)
+
+/* deadline: bandwidth is runtime / period in fixed point,
+   admission keeps the sum of each cpu under DL_BW_LIMIT */
+#define DL_BW_SHIFT 20
+#define DL_BW_LIMIT ((95 << DL_BW_SHIFT) / 100)
 
 /* used to save register infomation */
 typedef struct regs_context
@@ -90,57 +135,294 @@ typedef struct pcb
     /* BLOCK | READY | RUNNING */
     task_status_t status;
 
+    /* killed while it ran on another cpu, it exits on its next kernel entry */
+    int killed;
+
+    /* in do_exit, no longer counted as a live thread of its process */
+    int exiting;
+
+    /* cpu whose run queue holds this task (or which ran it last) */
+    int cpu;
+
+    /* cpus this task may run on, inherited by its children and threads */
+    uint32_t cpu_mask;
+
+    /* nice value, the one it runs with (lower while it holds a mutex
+       a more important task waits for) and the load weight of that */
+    int nice;
+    int pi_nice;
+    uint32_t weight;
+
+    /* the mutex it is blocked on, the next link of a priority
+       inheritance chain, and the mutexes it owns */
+    struct mutex_lock *pi_blocked_on;
+    list_head pi_mutexes;
+
+    /* the mutex it gets back when the condition it waits on is signaled */
+    struct mutex_lock *cond_mutex;
+
+    /* mlfq priority level, 0 is the highest, and the cpu time used of
+       the allotment of that level, kept across yields and preemptions */
+    int mlfq_level;
+    uint64_t mlfq_used;
+
+    /* virtual runtime, the key of `run_node` in a fair run queue */
+    uint64_t vruntime;
+    heap_node_t run_node;
+
+    /* deadline task parameters in ticks, dl_runtime is 0 for normal tasks */
+    uint64_t dl_runtime;
+    uint64_t dl_deadline;
+    uint64_t dl_period;
+
+    /* deadline of the current job (key of `run_node` in a deadline run
+       queue), budget left of it, and bandwidth reserved on dl_cpu */
+    uint64_t dl_abs_deadline;
+    uint64_t dl_budget;
+    uint64_t dl_bw;
+    int dl_cpu;
+
+    int dl_throttled;   /* waits for the next period */
+    int dl_done;        /* the current job is finished */
+    int dl_misses;      /* jobs that did not finish before their deadline */
+
+    /* starts a new job every period */
+    timer_t dl_timer;
+
+    /* cpu bandwidth group, NULL for none, and whether the task is
+       parked on the throttled list of its group instead of a run queue */
+    struct bw_group *bw_group;
+    int bw_throttled;
+
+    /* the thread it woke up last by IPC, handed the cpu when it blocks.
+       kept by id and looked up again then, it may have exited since */
+    pid_t wakee_pid;
+    pthread_t wakee_tid;
+
+    /* bytes it waits to send or receive on a mailbox */
+    int mbox_want;
+
+    /* kva of the futex word it waits on, 0 if it does not */
+    uint64_t futex_key;
+
+    /* ticks spent running, when the current run started,
+       and sum_exec_runtime when the task was picked */
+    uint64_t sum_exec_runtime;
+    uint64_t exec_start;
+    uint64_t slice_start;
+
+    /* statistics: ticks in user and kernel mode, ticks waited in a run
+       queue, and switches away while blocked or exited (voluntary) or
+       still ready (involuntary). `mode_start` is when the task last
+       entered or left the kernel, `wait_start` when it became ready */
+    uint64_t utime;
+    uint64_t stime;
+    uint64_t wait_time;
+    uint64_t nvcsw;
+    uint64_t nivcsw;
+    uint64_t mode_start;
+    uint64_t wait_start;
+
     /* cursor position */
     int cursor_x;
     int cursor_y;
 
-    /* time(seconds) to wake up sleeping PCB */
-    uint64_t wakeup_time;
+    /* wakes the PCB up when it is sleeping */
+    timer_t sleep_timer;
 
     /* inode number of current working directory */
     int cwd_inum;
 
     /* name of pcb(from corresponding task) */
     char name[16];
+
+    /* all tasks, the pid hash table and the (pid, tid) hash table */
+    list_node_t task_node;
+    list_node_t pid_node;
+    list_node_t tid_node;
 } pcb_t;
 
-/* ready queue to run */
-extern list_head ready_queue;
+/* scheduling statistics of a task and of a cpu filled by do_sched_stat,
+   times are in ticks. the layout is shared with user programs */
+typedef struct task_stat
+{
+    pid_t pid;
+    pthread_t tid;
+    char name[16];
+    int status;
+    int cpu;
+    int nice;
+    uint64_t utime;
+    uint64_t stime;
+    uint64_t wait_time;
+    uint64_t nvcsw;
+    uint64_t nivcsw;
+} task_stat_t;
+
+typedef struct cpu_stat
+{
+    uint64_t busy;
+    uint64_t idle;
+} cpu_stat_t;
+
+/* per-cpu run queue, the running task itself is not kept in it */
+typedef struct run_queue
+{
+    int nr_ready;
+
+    /* round robin: ready tasks in FIFO order */
+    list_head ready_queue;
+
+    /* fair: ready tasks ordered by vruntime, and their total weight */
+    heap_t fair_heap;
+    uint64_t min_vruntime;
+    uint64_t load;
+
+    /* mlfq: one FIFO queue per level, and the time of the last boost */
+    list_head mlfq_queues[MLFQ_LEVELS];
+    uint64_t last_boost;
+
+    /* deadline: ready tasks ordered by absolute deadline, the throttled
+       ones, number of the former, and total bandwidth admitted on this cpu */
+    heap_t dl_heap;
+    list_head dl_throttled;
+    int nr_dl;
+    uint64_t dl_bw;
+} run_queue_t;
+
+extern run_queue_t run_queues[NR_CPUS];
+
+/* operations of a scheduling policy on a run queue */
+typedef struct sched_class
+{
+    void (*enqueue_task)(run_queue_t *rq, pcb_t *p);
+    void (*dequeue_task)(run_queue_t *rq, pcb_t *p);
+    /* next task to run, it is left in the queue */
+    pcb_t *(*pick_next_task)(run_queue_t *rq);
+    /* charge `delta` ticks of cpu time to the running task */
+    void (*update_curr)(run_queue_t *rq, pcb_t *curr, uint64_t delta);
+    /* timer interrupt, returns 1 if curr should be preempted */
+    int (*task_tick)(run_queue_t *rq, pcb_t *curr);
+    /* optional: curr gives up the cpu of its own accord */
+    void (*yield_task)(run_queue_t *rq, pcb_t *curr);
+    /* optional: curr blocks, waiting for an event */
+    void (*block_task)(run_queue_t *rq, pcb_t *curr);
+    /* optional: p moves from run queue `src` to `dst` */
+    void (*migrate_task)(run_queue_t *src, run_queue_t *dst, pcb_t *p);
+} sched_class_t;
+
+extern const sched_class_t rr_sched_class;
+extern const sched_class_t fair_sched_class;
+extern const sched_class_t mlfq_sched_class;
+extern const sched_class_t dl_sched_class;
+
+static inline int is_dl_task(pcb_t *p) {
+    return p->dl_runtime != 0;
+}
+
+// only online cpus, a hart which never came up has no run queue served
+static inline int cpu_allowed(pcb_t *p, int cpu) {
+    return ((p->cpu_mask & cpu_online_mask) >> cpu) & 1;
+}
+
+// a deadline task out of budget waits for its next period, not for a cpu
+static inline int dl_parked(pcb_t *p) {
+    return is_dl_task(p) && p->dl_throttled;
+}
+
+void init_dl_entity(pcb_t *p);
+void dl_task_woken(pcb_t *p);
+void exit_dl_entity(pcb_t *p);
+
+/* cpu bandwidth group: its tasks together run at most `quota` ticks
+   every `period` ticks, then they are throttled until the next refill */
+typedef struct bw_group
+{
+    uint64_t quota;         /* 0 for an unused group */
+    uint64_t period;
+    int64_t runtime;        /* left in this period, below 0 after an overrun */
+    int throttled;
+    list_head throttled_list;   /* ready tasks parked until the refill */
+    timer_t refill_timer;
+    uint64_t nr_throttled;  /* periods in which the quota ran out */
+} bw_group_t;
+
+/* deadline tasks have a reservation of their own and are not limited */
+static inline int task_bw_limited(pcb_t *p) {
+    return p->bw_group != NULL && p->bw_group->quota != 0 && !is_dl_task(p);
+}
+
+static inline int task_bw_throttled(pcb_t *p) {
+    return task_bw_limited(p) && p->bw_group->throttled;
+}
+
+void init_bw_groups(void);
+int bw_check_throttle(pcb_t *curr);
+
+uint32_t nice_to_weight(int nice);
+void set_task_pi_nice(pcb_t *p, int pi_nice);
 
 /* sleep queue to be blocked in */
 extern list_head sleep_queue;
 
-/* current running task PCB */
+/* current running task PCB of each cpu */
 extern pcb_t * volatile runnings[NR_CPUS];
-extern pcb_t * volatile current_running;
+#define current_running (runnings[get_current_cpu_id()])
 extern pid_t process_id;
 
-extern pcb_t pcb[NUM_MAX_TASK];
-extern int threads[NUM_MAX_SUB_THREADS];
-extern pcb_t pid0_pcb;
+extern list_head task_list;
+extern int max_tasks;
+extern int max_threads;
+/* idle pcb of each cpu */
+extern pcb_t pid0_pcbs[NR_CPUS];
 extern const ptr_t pid0_stack;
-extern pcb_t pid0_pcb2;
 
 void ret_from_kernel();
+void ret_from_fork();
 
-pcb_t *create_pcb(char *name);
-void reset_pcb(pcb_t *p);
+void init_tasks(void);
+pcb_t *create_pcb(char *name, uint32_t cpu_mask);
+void wake_up_new_task(pcb_t *p);
+pcb_t *find_task(pid_t pid);
+pcb_t *find_thread(pid_t pid, pthread_t tid);
 
+void init_run_queues(void);
+void enqueue_task(pcb_t *p, int cpu);
+void dequeue_task(pcb_t *p);
+int nr_ready_tasks(void);
 void find_idle_task();
+int yield_to(pcb_t *to);
 
 extern void switch_to(pcb_t *prev, pcb_t *next);
 void do_scheduler(void);
+void scheduler_tick(void);
+void scheduler_ipi(void);
+void wake_up_idle_cpu(pcb_t *p);
+void update_timer(void);
 void do_sleep(uint32_t);
 
-void do_block(list_node_t *, list_head *queue);
+void do_block(list_node_t *, list_head *queue, spin_lock_t *lock);
+void do_block_to(list_node_t *, list_head *queue, spin_lock_t *lock, pid_t to_pid, pthread_t to_tid);
 void do_unblock(list_node_t *);
+void do_unblock_locked(list_node_t *);
 
 extern pid_t do_exec(char *name, int argc, char *argv[]);
+extern pid_t do_taskset_exec(char *name, int argc, char *argv[], uint32_t mask);
+extern int do_taskset(pid_t pid, uint32_t mask);
+extern int do_task_limit(int tasks, int threads);
 extern void do_exit(void);
 extern int do_kill(pid_t pid);
+extern void account_user_time(void);
+extern void account_kernel_time(void);
+extern int do_sched_stat(cpu_stat_t *cpus, int ncpus, task_stat_t *tasks, int ntasks);
+extern int do_cpu_quota(int gid, uint64_t quota_us, uint64_t period_us);
+extern int do_cpu_group(int gid, pid_t pid);
+extern int do_sched_policy(int policy);
 extern int do_waitpid(pid_t pid);
 extern void do_process_show();
 extern pid_t do_getpid();
+extern int do_nice(pid_t pid, int nice);
+extern int do_sched_deadline(pid_t pid, uint64_t runtime, uint64_t deadline, uint64_t period);
 
 pthread_t do_thread_create(long start_routine, long arg);
 pthread_t do_thread_join(pthread_t thread);
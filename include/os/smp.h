@@ -1,12 +1,24 @@
-#ifndef SMP_H
-#define SMP_H
-
-#define NR_CPUS 2
-extern void smp_init();
-extern void wakeup_other_hart();
-extern uint64_t get_current_cpu_id();
-extern void lock_kernel();
-extern void unlock_kernel();
-
-extern void slave_wait_for_task();
-#endif /* SMP_H */
+#ifndef SMP_H
+#define SMP_H
+
+#include <type.h>
+
+/* most harts the kernel runs on */
+#define NR_CPUS 8
+
+/* harts which came up, counted from 0 without a gap */
+extern int nr_cpus;
+extern volatile uint32_t cpu_online_mask;
+
+static inline int cpu_online(int cpu)
+{
+    return (cpu_online_mask >> cpu) & 1;
+}
+
+extern void smp_boot_secondaries();
+extern void set_cpu_online(int cpu);
+extern void send_resched_ipi(int cpu);
+extern uint64_t get_current_cpu_id();
+
+extern void slave_wait_for_task();
+#endif /* SMP_H */
@@ -29,17 +29,35 @@
 #define INCLUDE_TIME_H_
 
 #include <type.h>
+#include <os/heap.h>
 
 #define TIMER_INTERVAL 150000
 
+/* longest time a cpu sleeps without a timer interrupt in dynamic-tick mode */
+#define TICKLESS_MAX_INTERVAL (100 * TIMER_INTERVAL)
+
+/* kernel timer, `callback(arg)` is called once `get_ticks()` reaches its expiry time */
+typedef struct timer
+{
+    heap_node_t node;       /* keyed by expiry time(ticks) */
+    void (*callback)(void *arg);
+    void *arg;
+} timer_t;
+
 extern uint64_t time_base;
 extern uint64_t time_elapsed;
 
 extern uint64_t get_timer(void);
 extern uint64_t get_ticks(void);
 extern uint64_t get_time_base(void);
+extern uint64_t us_to_ticks(uint64_t us);
 extern void latency(uint64_t time);
 
-extern void check_sleeping(void);
+extern void init_timers(void);
+extern void timer_init(timer_t *timer, void (*callback)(void *), void *arg);
+extern void timer_add(timer_t *timer, uint64_t expires);
+extern void timer_del(timer_t *timer);
+extern uint64_t next_timer_expiry(void);
+extern void check_timers(void);
 
 #endif
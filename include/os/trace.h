@@ -0,0 +1,47 @@
+#ifndef INCLUDE_TRACE_H_
+#define INCLUDE_TRACE_H_
+
+#include <type.h>
+
+// scheduler event tracer: each cpu appends the events it sees to its
+// own ring, sys_sched_trace drains all rings. a full ring drops new
+// events instead of overwriting ones not drained yet
+#define TRACE_RING_SIZE 1024    // events per cpu, a power of 2
+
+typedef enum {
+    TRACE_SWITCH_IN,    // pid got the cpu, arg: pid switched out
+    TRACE_SWITCH_OUT,   // pid left the cpu, arg: its status afterwards
+    TRACE_BLOCK,        // pid blocked
+    TRACE_UNBLOCK,      // pid made ready, arg: pid of the waker (0: idle)
+    TRACE_TIMER,        // a timer of pid fired, an unblock may follow
+    TRACE_YIELD,        // pid called sys_yield
+} trace_type_t;
+
+// the layout is shared with user programs
+typedef struct trace_event
+{
+    uint64_t time;      // get_ticks()
+    uint32_t type;
+    uint32_t cpu;
+    int32_t pid;
+    int32_t tid;
+    int32_t arg;
+    int32_t pad;
+} trace_event_t;
+
+// commands of sys_sched_trace
+#define TRACE_STOP  0
+#define TRACE_START 1
+#define TRACE_READ  2
+
+struct pcb;
+extern int trace_enabled;
+
+extern void __trace_event(trace_type_t type, struct pcb *p, int arg);
+extern int do_sched_trace(int cmd, trace_event_t *buf, int n);
+
+static inline void trace_event(trace_type_t type, struct pcb *p, int arg) {
+    if (trace_enabled) __trace_event(type, p, arg);
+}
+
+#endif
@@ -29,12 +29,16 @@
 #define INCLUDE_SYSCALL_H_
 
 #include <os/sched.h>
+#include <os/lock.h>
 #include <type.h>
 
 #define NUM_SYSCALLS 96
 
 /* syscall function pointer */
 extern long (*syscall[NUM_SYSCALLS])();
+
+/* lock held around a syscall, NULL if its handler locks by itself */
+extern spin_lock_t *syscall_lock[NUM_SYSCALLS];
 extern void handle_syscall(regs_context_t *regs, uint64_t stval, uint64_t scause);
 
 #endif
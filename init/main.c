@@ -15,6 +15,7 @@
 #include <os/ioremap.h>
 #include <os/net.h>
 #include <os/fs.h>
+#include <os/trace.h>
 #include <sys/syscall.h>
 #include <screen.h>
 #include <printk.h>
@@ -42,21 +43,24 @@ static void unmap_boot_page();
 
 int main(void)
 {
-    lock_kernel();
+    // secondary harts are woken up once the master has initialized
+    // the kernel, see `smp_boot_secondaries`
+    int cpuid = get_current_cpu_id();
     unmap_boot_page();
 
-    int cpuid = get_current_cpu_id();
     if (cpuid == 0) {   // master processor
-        wakeup_other_hart();
         init_jmptab();
         init_task_info();
         init_kernel_freemem();
+        init_asid();
+
+        // Read CPU frequency
+        time_base = bios_read_fdt(TIMEBASE);
 
         init_pcb();
         printk("> [INIT] PCB initialization succeeded.\n");
 
-        // Read CPU frequency
-        time_base = bios_read_fdt(TIMEBASE);
+        init_timers();
 
         // FIXME: Please uncomment the following code after implementing file system
         // Read E1000 Registers Base Pointer
@@ -73,6 +77,8 @@ int main(void)
         init_barriers();
         init_conditions();
         init_mbox();
+        init_rwlocks();
+        init_futex();
         printk("> [INIT] Lock mechanism initialization succeeded.\n");
 
         init_exception();
@@ -91,25 +97,31 @@ int main(void)
 
         share_pgtable(current_running->pgdir, (PTE *)(PGDIR_VA));
         init_superblock();
+
+        smp_boot_secondaries();
+        printk("> [INIT] %d harts online.\n", nr_cpus);
+
+        spin_lock_acquire(&sched_lock);
     } else {            // slave processor
         setup_exception();
         set_timer(get_ticks() + TIMER_INTERVAL);
         
+        runnings[cpuid] = &pid0_pcbs[cpuid];
+        set_cpu_online(cpuid);
+
+        spin_lock_acquire(&sched_lock);
         slave_wait_for_task();
     }
                 
     printk("> [CPU] CPU ID: %d\n", cpuid);
-    // after switching context, kernel is unlocked
-    if (cpuid == 0) {
-        switch_to(&pid0_pcb, current_running); 
-    } else if (cpuid == 1) {
-        switch_to(&pid0_pcb2, current_running);
-    }
+    // sched_lock is released by the task switched to, and
+    // here once this cpu runs its idle pcb
+    switch_to(&pid0_pcbs[cpuid], current_running);
+    spin_lock_release(&sched_lock);
 
-    asm volatile("ld tp, %0"::"m"(current_running));
-    unlock_kernel();
+    asm volatile("mv tp, %0"::"r"(current_running));
+    update_timer();
     enable_interrupt();
-    set_timer(get_ticks() + TIMER_INTERVAL);
     while (1) {
         enable_preempt();
         asm volatile("wfi");
@@ -159,20 +171,27 @@ static void init_task_info(void)
 
 static void init_pcb(void)
 {
-    pid0_pcb.kernel_sp  = (uint64_t)kalloc()  + PAGE_SIZE - sizeof(regs_context_t);
-    pid0_pcb2.kernel_sp = (ptr_t)kalloc() + PAGE_SIZE - sizeof(regs_context_t);
-    
-    strcpy(pid0_pcb.name, "pid0_pcb");
-    strcpy(pid0_pcb2.name, "pid0_pcb2");
+    // one idle pcb per hart, it runs `main` on the boot stack of the hart
+    for (int i = 0; i < NR_CPUS; i++) {
+        pid0_pcbs[i].pgdir     = (PTE *)PGDIR_VA;
+        pid0_pcbs[i].cpu       = i;
+        pid0_pcbs[i].kernel_sp = (ptr_t)kalloc() + PAGE_SIZE - sizeof(regs_context_t);
+        strcpy(pid0_pcbs[i].name, "pid0_pcb");
+    }
 
-    for (int i = tasks_num; i < 16; i++) pcb[i].pid = 0;
+    init_tasks();
+    init_run_queues();
+    init_bw_groups();
 
-    pcb_t *p  = create_pcb("shell");
+    // the shell runs at once, so take it off the run queue
+    pcb_t *p  = create_pcb("shell", CPU_MASK_ALL);
+    wake_up_new_task(p);
+    dequeue_task(p);
     p->status = TASK_RUNNING;
+    p->mode_start = get_ticks();
 
-    // only cpu0(master processor) can initialize current_running
-    runnings[0] = list_entry(ready_queue.next, pcb_t);
-    current_running = runnings[0];
+    // only cpu0(master processor) can initialize its current_running
+    runnings[0] = p;
 }
 
 static void init_syscall(void)
@@ -186,6 +205,16 @@ static void init_syscall(void)
     syscall[SYSCALL_PS]             = (long (*)())do_process_show;
     syscall[SYSCALL_GETPID]         = (long (*)())do_getpid;
     syscall[SYSCALL_YIELD]          = (long (*)())do_scheduler;
+    syscall[SYSCALL_NICE]           = (long (*)())do_nice;
+    syscall[SYSCALL_SCHED_DEADLINE] = (long (*)())do_sched_deadline;
+    syscall[SYSCALL_TASKSET]        = (long (*)())do_taskset;
+    syscall[SYSCALL_TASKSET_EXEC]   = (long (*)())do_taskset_exec;
+    syscall[SYSCALL_TASK_LIMIT]     = (long (*)())do_task_limit;
+    syscall[SYSCALL_SCHED_STAT]     = (long (*)())do_sched_stat;
+    syscall[SYSCALL_SCHED_TRACE]    = (long (*)())do_sched_trace;
+    syscall[SYSCALL_CPU_QUOTA]      = (long (*)())do_cpu_quota;
+    syscall[SYSCALL_CPU_GROUP]      = (long (*)())do_cpu_group;
+    syscall[SYSCALL_SCHED_POLICY]   = (long (*)())do_sched_policy;
 
     syscall[SYSCALL_WRITE]          = (long (*)())screen_write;
     syscall[SYSCALL_READCH]         = (long (*)())bios_getchar;
@@ -203,6 +232,7 @@ static void init_syscall(void)
     syscall[SYSCALL_LOCK_INIT]      = (long (*)())do_mutex_lock_init;
     syscall[SYSCALL_LOCK_ACQ]       = (long (*)())do_mutex_lock_acquire;
     syscall[SYSCALL_LOCK_RELEASE]   = (long (*)())do_mutex_lock_release;
+    syscall[SYSCALL_LOCK_DESTROY]   = (long (*)())do_mutex_lock_destroy;
 
     syscall[SYSCALL_BARR_INIT]      = (long (*)())do_barrier_init;
     syscall[SYSCALL_BARR_WAIT]      = (long (*)())do_barrier_wait;
@@ -218,10 +248,15 @@ static void init_syscall(void)
     syscall[SYSCALL_MBOX_CLOSE]     = (long (*)())do_mbox_close;
     syscall[SYSCALL_MBOX_SEND]      = (long (*)())do_mbox_send;
     syscall[SYSCALL_MBOX_RECV]      = (long (*)())do_mbox_recv;
+    syscall[SYSCALL_MBOX_SEND_PAGES] = (long (*)())do_mbox_send_pages;
+    syscall[SYSCALL_MBOX_RECV_PAGES] = (long (*)())do_mbox_recv_pages;
 
     syscall[SYSCALL_SHM_GET]        = (long (*)())shm_page_get;
     syscall[SYSCALL_SHM_DT]         = (long (*)())shm_page_dt;
 
+    syscall[SYSCALL_FUTEX_WAIT]     = (long (*)())do_futex_wait;
+    syscall[SYSCALL_FUTEX_WAKE]     = (long (*)())do_futex_wake;
+
     syscall[SYSCALL_NET_SEND]       = (long (*)())do_net_send;
     syscall[SYSCALL_NET_RECV]       = (long (*)())do_net_recv;
 
@@ -240,6 +275,36 @@ static void init_syscall(void)
     syscall[SYSCALL_FS_LN]          = (long (*)())do_ln;
     syscall[SYSCALL_FS_RM]          = (long (*)())do_rm;
     syscall[SYSCALL_FS_LSEEK]       = (long (*)())do_lseek;
+
+    syscall[SYSCALL_RWLOCK_INIT]    = (long (*)())do_rwlock_init;
+    syscall[SYSCALL_RWLOCK_RDLOCK]  = (long (*)())do_rwlock_rdlock;
+    syscall[SYSCALL_RWLOCK_WRLOCK]  = (long (*)())do_rwlock_wrlock;
+    syscall[SYSCALL_RWLOCK_UNLOCK]  = (long (*)())do_rwlock_unlock;
+    syscall[SYSCALL_RWLOCK_DESTROY] = (long (*)())do_rwlock_destroy;
+
+    // the handlers of these subsystems do not lock by themselves, a
+    // scheduler syscall which blocks holds sched_lock again on return
+    syscall_lock[SYSCALL_SLEEP]          = &sched_lock;
+    syscall_lock[SYSCALL_WAITPID]        = &sched_lock;
+    syscall_lock[SYSCALL_PS]             = &sched_lock;
+    syscall_lock[SYSCALL_NICE]           = &sched_lock;
+    syscall_lock[SYSCALL_SCHED_DEADLINE] = &sched_lock;
+    syscall_lock[SYSCALL_TASKSET]        = &sched_lock;
+    syscall_lock[SYSCALL_TASK_LIMIT]     = &sched_lock;
+    syscall_lock[SYSCALL_SCHED_STAT]     = &sched_lock;
+    syscall_lock[SYSCALL_SCHED_TRACE]    = &sched_lock;
+    syscall_lock[SYSCALL_CPU_QUOTA]      = &sched_lock;
+    syscall_lock[SYSCALL_CPU_GROUP]      = &sched_lock;
+    syscall_lock[SYSCALL_SCHED_POLICY]   = &sched_lock;
+    syscall_lock[SYSCALL_THREAD_CREATE]  = &sched_lock;
+    syscall_lock[SYSCALL_THREAD_JOIN]    = &sched_lock;
+
+    for (int i = SYSCALL_FS_MKFS; i <= SYSCALL_FS_LSEEK; i++) {
+        syscall_lock[i] = &fs_lock;
+    }
+    syscall_lock[SYSCALL_SHM_GET]        = &mm_lock;
+    syscall_lock[SYSCALL_SHM_DT]         = &mm_lock;
+    syscall_lock[SYSCALL_READCH]         = &screen_lock;
 }
 
 // clear the mapping of boot address
@@ -253,4 +318,5 @@ static void unmap_boot_page() {
 
     clear_pgdir((uintptr_t)pmd);
     pgdir[vpn2] = 0;
+    local_flush_tlb_all();
 }
\ No newline at end of file
@@ -3,12 +3,16 @@
 #include <os/fs.h>
 #include <os/kernel.h>
 #include <os/time.h>
+#include <os/lock.h>
 
 static superblock_t superblock;
 static fdesc_t fdesc_array[NUM_FDESCS];
 
 static char block_buf[NBYTES_PER_BLOCK];
 
+// the fs syscalls run under fs_lock, see init_syscall
+spin_lock_t fs_lock;
+
 int popcnt(uint64_t val) {
     int cnt = 0;
     while (val != 0) {
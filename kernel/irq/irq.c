@@ -7,12 +7,11 @@
 #include <os/smp.h>
 #include <os/mm.h>
 #include <pgtable.h>
+#include <csr.h>
 #include <printk.h>
 #include <assert.h>
 #include <screen.h>
 
-spin_lock_t kernel_spin_lock;
-
 handler_t irq_table[IRQC_COUNT];
 handler_t exc_table[EXCC_COUNT];
 
@@ -30,13 +29,14 @@ extern void ret_from_exception();
 
 void interrupt_helper(regs_context_t *regs, uint64_t stval, uint64_t scause)
 {
-    // every time a processor wants to enter kernel
-    // it must first acquire the kernel spin lock
-    lock_kernel();
+    // no lock is held here, each handler takes the locks of
+    // the subsystems it works on
+    account_user_time();
 
-    // store tp(current_running pcb) to variable current_running
-    // here, current_running == runnings[cpuid] -> true
-    current_running = runnings[get_current_cpu_id()];
+    // the task was killed by another cpu while it ran on this one
+    if (current_running->killed) {
+        do_exit();
+    }
 
     // call corresponding handler by the value of `scause`
     if (scause & 0x8000000000000000L) { /* Interrupt bit is 1 */
@@ -52,33 +52,35 @@ void interrupt_helper(regs_context_t *regs, uint64_t stval, uint64_t scause)
 void handle_irq_timer(regs_context_t *regs, uint64_t stval, uint64_t scause)
 {
     // clock interrupt handler.
-    // use bios_set_timer to reset the timer and remember to reschedule
-    set_timer(get_ticks() + TIMER_INTERVAL);
-    do_scheduler();
+    // the timer is reprogrammed by update_timer on the way out of the kernel
+    scheduler_tick();
+}
+
+void handle_irq_soft(regs_context_t *regs, uint64_t stval, uint64_t scause)
+{
+    // inter-processor interrupt handler, the pending bit is cleared by software
+    asm volatile("csrc sip, %0" : : "r"(SIE_SSIE));
+    mm_shootdown_ack();
+    scheduler_ipi();
 }
 
 void handle_page_fault(regs_context_t *regs, uint64_t stval, uint64_t scause) {
     PTE *pgdir = current_running->pgdir;
 
+    spin_lock_acquire(&mm_lock);
+
     uint64_t fault_addr_uva = stval & (~((1 << NORMAL_PAGE_SHIFT)-1));
-    uint64_t fault_addr_kva = get_kva_of_uva(fault_addr_uva, current_running->pgdir);
-
-    // uva not allocated & mapped
-    if (fault_addr_kva == 0) {
-        alloc_page_helper(fault_addr_uva, pgdir);
-    } else {
-        page_t *page = find_page_with_uva(fault_addr_uva, pgdir, &swapped_pages_queue);
-        if (present_pages_num >= MAX_PRESENT_PFN) {
-            swap_out();
-        }
-        swap_in(page);
-    }
+
+    // allocate a page never touched, or swap it in
+    page_fault_in(fault_addr_uva, pgdir);
 
     PTE *pte = get_pte_of_uva(fault_addr_uva, pgdir);
     set_attribute(pte, _PAGE_ACCESSED);
     if (scause == EXCC_STORE_PAGE_FAULT) {
         set_attribute(pte, _PAGE_DIRTY);
     }
+    mm_flush_page(pgdir, fault_addr_uva);
+    spin_lock_release(&mm_lock);
 }
 
 void handle_other(regs_context_t *regs, uint64_t stval, uint64_t scause)
@@ -123,6 +125,7 @@ void init_exception()
         irq_table[code] = handle_other;
     }
     irq_table[IRQC_S_TIMER] = handle_irq_timer;
+    irq_table[IRQC_S_SOFT]  = handle_irq_soft;
 
     /* set up the entrypoint of exceptions */
     setup_exception();
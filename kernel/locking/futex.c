@@ -0,0 +1,117 @@
+#include <os/lock.h>
+#include <os/sched.h>
+#include <os/mm.h>
+#include <os/list.h>
+#include <pgtable.h>
+
+// futexes: a user word which the kernel only sees once a thread has to
+// wait for it. a waiter is queued on the hash bucket of the physical
+// address of the word, so the threads of a process and processes which
+// map the same share page meet on one key. the page is pinned while a
+// waiter sleeps, it is not swapped out and its address stays the key.
+// there is no other kernel state, the user library does the
+// uncontended cases by itself.
+
+#define FUTEX_HASH_SIZE 64
+
+static list_head futex_queues[FUTEX_HASH_SIZE];
+
+void init_futex(void)
+{
+    for (int i = 0; i < FUTEX_HASH_SIZE; i++) {
+        INIT_LIST_HEAD(&futex_queues[i]);
+    }
+}
+
+static inline list_head *futex_queue(uint64_t key)
+{
+    return &futex_queues[(key >> 2) % FUTEX_HASH_SIZE];
+}
+
+// the kva of the user word, or 0 if its page is not present, and then
+// no one waits on it: the page of a waiter is pinned in memory
+static uint64_t futex_key(int *uaddr)
+{
+    uint64_t key = 0;
+
+    spin_lock_acquire(&mm_lock);
+    PTE *pte = get_pte_of_uva((uint64_t)uaddr, current_running->pgdir);
+    if (pte != NULL && (*pte & _PAGE_PRESENT)) {
+        key = get_kva_of_uva((uint64_t)uaddr, current_running->pgdir);
+    }
+    spin_lock_release(&mm_lock);
+
+    return key;
+}
+
+// block until a futex_wake on `uaddr` if it still holds `val`, a page
+// which is not present is brought in as a page fault would.
+// return 0 when woken up, or -1 at once if the word changed
+int do_futex_wait(int *uaddr, int val)
+{
+    if ((uint64_t)uaddr & 3) return -1;
+
+    spin_lock_acquire(&ipc_lock);
+    spin_lock_acquire(&mm_lock);
+    uint64_t key = page_fault_in((uint64_t)uaddr, current_running->pgdir);
+
+    // the word is read with ipc_lock held: a waker which stored to it
+    // before futex_wake either is seen here or finds this task queued
+    if (*(volatile int *)key != val) {
+        spin_lock_release(&mm_lock);
+        spin_lock_release(&ipc_lock);
+        return -1;
+    }
+    page_pin(key);
+    spin_lock_release(&mm_lock);
+
+    current_running->futex_key = key;
+    do_block(&current_running->list, futex_queue(key), &ipc_lock);
+
+    spin_lock_acquire(&mm_lock);
+    futex_unpin(current_running);
+    spin_lock_release(&mm_lock);
+
+    spin_lock_release(&ipc_lock);
+    return 0;
+}
+
+// a waiter was woken up, or killed while it slept: release its page.
+// called with mm_lock held
+void futex_unpin(pcb_t *p)
+{
+    if (p->futex_key == 0) return;
+
+    page_unpin(p->futex_key);
+    p->futex_key = 0;
+}
+
+// wake up at most `n` tasks waiting on `uaddr`, return how many
+int do_futex_wake(int *uaddr, int n)
+{
+    int woken = 0;
+
+    if ((uint64_t)uaddr & 3) return 0;
+
+    spin_lock_acquire(&ipc_lock);
+    uint64_t key = futex_key(uaddr);
+    if (key == 0) {
+        spin_lock_release(&ipc_lock);
+        return 0;
+    }
+
+    list_head *queue = futex_queue(key);
+    list_node_t *node = queue->next;
+    while (node != queue && woken < n) {
+        list_node_t *next = node->next;
+        pcb_t *p = list_entry(node, pcb_t);
+        if (p->futex_key == key) {
+            do_unblock(node);
+            woken++;
+        }
+        node = next;
+    }
+
+    spin_lock_release(&ipc_lock);
+    return woken;
+}
@@ -0,0 +1,118 @@
+#include <os/handle.h>
+#include <os/string.h>
+
+// handle tables: the objects of a table come from its slab and are
+// hashed by key, so unrelated keys never share an object and an open
+// only walks one bucket. handles index a two-level table which grows a
+// page at a time, freed slots are reused first with a new generation.
+// callers hold the lock of the objects (ipc_lock)
+
+void handle_table_init(handle_table_t *table, uint32_t obj_size)
+{
+    slab_cache_init(&table->cache, obj_size);
+    for (int i = 0; i < HANDLE_HASH_SIZE; i++) {
+        INIT_LIST_HEAD(&table->buckets[i]);
+    }
+    table->dir = NULL;
+    table->nr_handles  = 0;
+    table->free_handle = -1;
+    table->nr_objs     = 0;
+}
+
+list_head *handle_bucket(handle_table_t *table, uint32_t hash)
+{
+    return &table->buckets[(hash * 2654435761u) >> (32 - HANDLE_HASH_BITS)];
+}
+
+// the object with key `hash`, or NULL
+handle_obj_t *handle_find(handle_table_t *table, uint32_t hash)
+{
+    list_head *bucket = handle_bucket(table, hash);
+    for (list_node_t *node = bucket->next; node != bucket; node = node->next) {
+        handle_obj_t *obj = list_entry_of(node, handle_obj_t, hash_node);
+        if (obj->hash == hash) return obj;
+    }
+    return NULL;
+}
+
+// the object with key `hash` with one more reference, or a new one if
+// there is none (`*created` is set then). NULL if out of handles
+handle_obj_t *handle_open(handle_table_t *table, uint32_t hash, int *created)
+{
+    handle_obj_t *obj = handle_find(table, hash);
+
+    *created = obj == NULL;
+    if (obj != NULL) {
+        obj->ref++;
+        return obj;
+    }
+    return handle_alloc(table, hash);
+}
+
+static uintptr_t *handle_slot(handle_table_t *table, int index)
+{
+    return &table->dir[index / HANDLES_PER_PAGE][index % HANDLES_PER_PAGE];
+}
+
+// a cleared object hashed by `hash` with one reference and a handle,
+// or NULL if the table has run out of handles
+handle_obj_t *handle_alloc(handle_table_t *table, uint32_t hash)
+{
+    int index = table->free_handle;
+    int gen = 0;
+
+    if (index >= 0) {
+        uintptr_t slot = *handle_slot(table, index);
+        table->free_handle = (int)((uint32_t)slot >> 1) - 1;
+        gen = slot >> 32;
+    } else {
+        if (table->nr_handles >= MAX_HANDLES) return NULL;
+
+        index = table->nr_handles++;
+        if (table->dir == NULL) table->dir = (uintptr_t **)kalloc();
+        if (table->dir[index / HANDLES_PER_PAGE] == NULL) {
+            table->dir[index / HANDLES_PER_PAGE] = (uintptr_t *)kalloc();
+        }
+    }
+    int handle = (gen << HANDLE_INDEX_BITS) | index;
+
+    handle_obj_t *obj = (handle_obj_t *)slab_alloc(&table->cache);
+    memset(obj, 0, table->cache.size);
+    obj->hash   = hash;
+    obj->handle = handle;
+    obj->ref    = 1;
+
+    *handle_slot(table, index) = (uintptr_t)obj;
+    list_add_tail(&obj->hash_node, handle_bucket(table, hash));
+    table->nr_objs++;
+    return obj;
+}
+
+void handle_free(handle_table_t *table, handle_obj_t *obj)
+{
+    int index = obj->handle & HANDLE_INDEX_MASK;
+    uintptr_t gen = ((obj->handle >> HANDLE_INDEX_BITS) + 1) & HANDLE_GEN_MASK;
+
+    // the free list is kept in the slots, +1 so that -1 ends it
+    *handle_slot(table, index) = (gen << 32) | ((uintptr_t)(table->free_handle + 1) << 1) | 1;
+    table->free_handle = index;
+
+    list_delete_entry(&obj->hash_node);
+    slab_free(&table->cache, obj);
+    table->nr_objs--;
+}
+
+// the object of `handle`, or NULL for a handle not in use, including
+// one whose object was freed and whose slot was given to another
+handle_obj_t *handle_get(handle_table_t *table, int handle)
+{
+    int index = handle & HANDLE_INDEX_MASK;
+
+    if (handle < 0 || index >= table->nr_handles) return NULL;
+
+    uintptr_t slot = *handle_slot(table, index);
+    if (slot & 1) return NULL;
+
+    handle_obj_t *obj = (handle_obj_t *)slot;
+    return obj->handle == handle ? obj : NULL;
+}
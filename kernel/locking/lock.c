@@ -2,307 +2,925 @@
 #include <os/sched.h>
 #include <os/list.h>
 #include <os/string.h>
+#include <os/time.h>
 #include <atomic.h>
 
-mutex_lock_t mlocks[LOCK_NUM];
-barrier_t barriers[BARRIER_NUM];
-condition_t conditions[CONDITION_NUM];
-mailbox_t mailboxes[MBOX_NUM];
+static handle_table_t mutex_table;
+static handle_table_t barrier_table;
+static handle_table_t condition_table;
+static handle_table_t mbox_table;
+static handle_table_t rwlock_table;
+
+// protects the tables above and the wait queues in them
+spin_lock_t ipc_lock;
+
+// the sd card is driven through the bios, one request at a time
+spin_lock_t sd_lock;
 
 void init_locks(void)
 {
-    for (int i = 0; i < LOCK_NUM; i++) {
-        spin_lock_init(&mlocks[i].lock);
-        INIT_LIST_HEAD(&mlocks[i].block_queue);
-        mlocks[i].pid = 0;
-    }
+    handle_table_init(&mutex_table, sizeof(mutex_lock_t));
+}
+
+// the objects of the handles passed in by the user, NULL for a stale
+// or made up handle. called with ipc_lock held
+static inline mutex_lock_t *get_mutex(int handle)
+{
+    return (mutex_lock_t *)handle_get(&mutex_table, handle);
+}
+
+static inline barrier_t *get_barrier(int handle)
+{
+    return (barrier_t *)handle_get(&barrier_table, handle);
+}
+
+static inline condition_t *get_condition(int handle)
+{
+    return (condition_t *)handle_get(&condition_table, handle);
+}
+
+static inline mailbox_t *get_mbox(int handle)
+{
+    return (mailbox_t *)handle_get(&mbox_table, handle);
+}
+
+static inline rwlock_t *get_rwlock(int handle)
+{
+    return (rwlock_t *)handle_get(&rwlock_table, handle);
 }
 
 void spin_lock_init(spin_lock_t *lock)
 {
-    lock->status = UNLOCKED;
+    lock->val = 0;
 }
 
+// take the lock only if nobody holds or waits for it,
+// return UNLOCKED if it was taken, LOCKED otherwise
 int spin_lock_try_acquire(spin_lock_t *lock)
 {
-    return atomic_swap(LOCKED, (ptr_t)lock);
+    uint32_t old = lock->val;
+    if ((old & 0xffff) != (old >> 16)) return LOCKED;
+
+    return atomic_cmpxchg(old, old + (1u << 16), (ptr_t)&lock->val) == old ? UNLOCKED : LOCKED;
 }
 
 void spin_lock_acquire(spin_lock_t *lock)
 {
-    while (spin_lock_try_acquire(lock) == LOCKED);
+    uint16_t ticket = atomic_fetch_add(1u << 16, (ptr_t)&lock->val) >> 16;
+    while (lock->owner != ticket) {
+        // the holder may wait for this cpu to flush its TLB
+        mm_shootdown_ack();
+    }
+    smp_mb();
 }
 
+// only the holder writes `owner`, a plain store hands the lock on
 void spin_lock_release(spin_lock_t *lock)
 {
-    atomic_swap(UNLOCKED, (ptr_t)lock);
+    smp_mb();
+    lock->owner = lock->owner + 1;
 }
 
+// the mutex of `key`, created on first use. return its handle, or -1
 int do_mutex_lock_init(int key)
 {
-    int index = key % LOCK_NUM;
-    mlocks[index].key = key;
+    int created;
+
+    spin_lock_acquire(&ipc_lock);
+    mutex_lock_t *mutex = (mutex_lock_t *)handle_open(&mutex_table, key, &created);
+    if (mutex != NULL && created) {
+        spin_lock_init(&mutex->lock);
+        INIT_LIST_HEAD(&mutex->block_queue);
+        INIT_LIST_HEAD(&mutex->owner_node);
+    }
+    int handle = mutex != NULL ? mutex->obj.handle : -1;
+    spin_lock_release(&ipc_lock);
 
-    return index;
+    return handle;
 }
 
-void do_mutex_lock_acquire(int mlock_idx)
+// free a mutex nobody refers to once it is unlocked
+static void mutex_put(mutex_lock_t *mutex)
+{
+    if (mutex->obj.ref == 0 && !spin_lock_is_locked(&mutex->lock)) {
+        handle_free(&mutex_table, &mutex->obj);
+    }
+}
+
+// drop a reference to the mutex, return 0 for a stale handle
+int do_mutex_lock_destroy(int mlock_idx)
+{
+    spin_lock_acquire(&ipc_lock);
+    mutex_lock_t *mutex = get_mutex(mlock_idx);
+    if (mutex != NULL && mutex->obj.ref > 0) {
+        mutex->obj.ref--;
+        mutex_put(mutex);
+    }
+    spin_lock_release(&ipc_lock);
+
+    return mutex != NULL;
+}
+
+// priority inheritance: the owner of a mutex runs with the lowest nice
+// value of itself and the tasks waiting for the mutexes it holds, so a
+// waiter is not held up by tasks less important than itself. only the
+// nice value is inherited, so this only helps an owner of the fair
+// class: round robin and mlfq ignore nice, and a deadline owner already
+// runs before every other class. a deadline waiter boosts a fair owner
+// to NICE_MIN, its deadline is not inherited. the helpers below and the
+// mutex helpers are called with ipc_lock held
+
+// `p` owns `mutex` from now on, NULL for nobody
+static void mutex_set_owner(mutex_lock_t *mutex, pcb_t *p)
+{
+    list_delete_init(&mutex->owner_node);
+    mutex->owner = p;
+    mutex->pid   = p != NULL ? p->pid : 0;
+    if (p != NULL) list_add_tail(&mutex->owner_node, &p->pi_mutexes);
+}
+
+static int waiter_pi_nice(pcb_t *p)
 {
-    mutex_lock_t *mutex = &mlocks[mlock_idx];
+    return is_dl_task(p) ? NICE_MIN : p->pi_nice;
+}
+
+// a task with `nice` waits for `mutex`: boost its owner, and the owner
+// of the mutex that one is blocked on, and so on down the chain
+static void pi_boost(mutex_lock_t *mutex, int nice)
+{
+    spin_lock_acquire(&sched_lock);
+    for (int depth = 0; mutex != NULL && depth < PI_CHAIN_MAX; depth++) {
+        pcb_t *owner = mutex->owner;
+        if (owner == NULL || owner->pi_nice <= nice) break;
+
+        set_task_pi_nice(owner, nice);
+        mutex = owner->pi_blocked_on;
+    }
+    spin_lock_release(&sched_lock);
+}
+
+// recompute the nice value `p` runs with from the waiters of the
+// mutexes it still holds, which undoes the boosts of a released one
+static void pi_restore(pcb_t *p)
+{
+    int nice = p->nice;
+
+    for (list_node_t *node = p->pi_mutexes.next; node != &p->pi_mutexes; node = node->next) {
+        mutex_lock_t *mutex = list_entry_of(node, mutex_lock_t, owner_node);
+
+        list_head *queue = &mutex->block_queue;
+        for (list_node_t *n = queue->next; n != queue; n = n->next) {
+            pcb_t *w = list_entry(n, pcb_t);
+            if (waiter_pi_nice(w) < nice) nice = waiter_pi_nice(w);
+        }
+    }
+
+    spin_lock_acquire(&sched_lock);
+    set_task_pi_nice(p, nice);
+    spin_lock_release(&sched_lock);
+}
 
+static void mutex_acquire(mutex_lock_t *mutex)
+{
     if (spin_lock_try_acquire(&mutex->lock) == UNLOCKED) {
-        mutex->pid = current_running->pid;
+        mutex_set_owner(mutex, current_running);
         return;
-    } else do_block(&current_running->list, &mutex->block_queue);
+    }
+
+    // the owner hands the mutex over when it releases it
+    current_running->pi_blocked_on = mutex;
+    pi_boost(mutex, waiter_pi_nice(current_running));
+    do_block(&current_running->list, &mutex->block_queue, &ipc_lock);
 }
 
-void do_mutex_lock_release(int mlock_idx)
+// the most important waiter, the one which waited longest among equals
+static pcb_t *mutex_top_waiter(mutex_lock_t *mutex)
 {
-    mutex_lock_t *mutex = &mlocks[mlock_idx];
-    
+    pcb_t *top = NULL;
+
+    list_head *queue = &mutex->block_queue;
+    for (list_node_t *node = queue->next; node != queue; node = node->next) {
+        pcb_t *w = list_entry(node, pcb_t);
+        if (top == NULL || waiter_pi_nice(w) < waiter_pi_nice(top)) top = w;
+    }
+    return top;
+}
+
+static void mutex_release(mutex_lock_t *mutex)
+{
+    pcb_t *prev = mutex->owner;
+
     if (is_queue_empty(&mutex->block_queue)) {
+        mutex_set_owner(mutex, NULL);
         spin_lock_release(&mutex->lock);
-        mutex->pid = 0;
     } else {
-        list_node_t *pcb_node = mutex->block_queue.next;
-        pcb_t *p = list_entry(pcb_node, pcb_t);
-        mutex->pid = p->pid;
+        pcb_t *p = mutex_top_waiter(mutex);
+        mutex_set_owner(mutex, p);
+
+        p->pi_blocked_on = NULL;
+        do_unblock(&p->list);
+
+        // the waiters left behind now boost the new owner, on top of
+        // whatever the mutexes it already holds give it
+        int nice = p->pi_nice;
+        list_head *queue = &mutex->block_queue;
+        for (list_node_t *node = queue->next; node != queue; node = node->next) {
+            pcb_t *w = list_entry(node, pcb_t);
+            if (waiter_pi_nice(w) < nice) nice = waiter_pi_nice(w);
+        }
+        spin_lock_acquire(&sched_lock);
+        set_task_pi_nice(p, nice);
+        spin_lock_release(&sched_lock);
+    }
+
+    // an owner released on exit or kill is gone, there is nothing to undo.
+    // only a boosted owner has anything to undo, and the new owner was
+    // not boosted by this one before
+    if (prev == current_running && prev->pi_nice != prev->nice) pi_restore(prev);
+}
+
+// whether a waiter should keep spinning on `mutex`: its owner runs on
+// another cpu and is likely to release it soon. nobody must be queued,
+// a queued waiter is handed the mutex and a spinner would never get it.
+// this peeks without ipc_lock, a stale owner (pcbs come from a slab and
+// stay readable) only makes the waiter block or spin a bit longer
+static int mutex_owner_spinnable(mutex_lock_t *mutex, uint64_t deadline)
+{
+    pcb_t *owner = mutex->owner;
+
+    if (get_ticks() >= deadline) return 0;
+    if (!is_queue_empty(&mutex->block_queue)) return 0;
+    if (!spin_lock_is_locked(&mutex->lock)) return 1;
+    return owner != NULL && owner != current_running && owner->status == TASK_RUNNING;
+}
 
-        do_unblock(pcb_node);
+// adaptive: spin while the owner is running on another cpu, as a short
+// critical section is over before two context switches would be, and
+// block in the queue once the owner is off cpu or the budget is spent
+void do_mutex_lock_acquire(int mlock_idx)
+{
+    uint64_t deadline = get_ticks() + MUTEX_SPIN_US * time_base / 1000000;
+    int taken = 0;
+
+    // pinned by a reference while spinning without ipc_lock, a destroy
+    // meanwhile cannot free it and leaves that to the unpin below
+    spin_lock_acquire(&ipc_lock);
+    mutex_lock_t *mutex = get_mutex(mlock_idx);
+    if (mutex != NULL) mutex->obj.ref++;
+    spin_lock_release(&ipc_lock);
+    if (mutex == NULL) return;
+
+    while (mutex_owner_spinnable(mutex, deadline)) {
+        // no release can come in between, the mutex is ours
+        if (!spin_lock_is_locked(&mutex->lock) &&
+            spin_lock_try_acquire(&mutex->lock) == UNLOCKED) {
+            taken = 1;
+            break;
+        }
     }
+
+    spin_lock_acquire(&ipc_lock);
+    if (taken) mutex_set_owner(mutex, current_running);
+
+    if (--mutex->obj.ref == 0) {
+        // destroyed while spinning, nobody refers to it any more
+        if (taken) mutex_release(mutex);
+        mutex_put(mutex);
+    } else if (!taken) {
+        mutex_acquire(mutex);
+    }
+    spin_lock_release(&ipc_lock);
 }
 
-void init_barriers() {
-    for (int i = 0; i < BARRIER_NUM; i++) {
-        barriers[i].goal = 0, barriers[i].current = 0;
-        INIT_LIST_HEAD(&barriers[i].block_list);
+void do_mutex_lock_release(int mlock_idx)
+{
+    spin_lock_acquire(&ipc_lock);
+    mutex_lock_t *mutex = get_mutex(mlock_idx);
+    if (mutex != NULL) {
+        mutex_release(mutex);
+        mutex_put(mutex);
+    }
+    spin_lock_release(&ipc_lock);
+}
+
+static void rwlock_release(rwlock_t *rw, pid_t pid);
+
+// `p` is killed and its pcb about to be freed: move the mutexes it
+// owns to `orphans`, they stay locked until release_task_mutexes
+void disown_task_mutexes(pcb_t *p, list_head *orphans)
+{
+    while (!is_queue_empty(&p->pi_mutexes)) {
+        mutex_lock_t *mutex = list_entry_of(p->pi_mutexes.next, mutex_lock_t, owner_node);
+        list_delete_entry(&mutex->owner_node);
+        list_add_tail(&mutex->owner_node, orphans);
+        mutex->owner = NULL;
     }
 }
 
+// a thread of process `pid` is gone: release the mutexes of `owned`,
+// the ones it owned, while its siblings keep theirs. the last thread
+// also releases whatever the process still holds, the mutexes of
+// siblings killed meanwhile and the rwlocks held for writing, which
+// are kept by pid. read holds are only counted, they are not known
+// to belong to anyone
+void release_task_mutexes(list_head *owned, pid_t pid, int last_thread)
+{
+    handle_obj_t *obj;
+    list_node_t *node;
+    int bucket;
+
+    spin_lock_acquire(&ipc_lock);
+
+    // a release hands the mutex on, which unlinks it from `owned`
+    while (!is_queue_empty(owned)) {
+        mutex_lock_t *mutex = list_entry_of(owned->next, mutex_lock_t, owner_node);
+        mutex_release(mutex);
+        mutex_put(mutex);
+    }
+    if (!last_thread) {
+        spin_lock_release(&ipc_lock);
+        return;
+    }
+
+    // nothing is freed while walking the tables, an object nobody
+    // refers to any more is freed by its next destroy or release
+    handle_for_each(obj, &mutex_table, bucket, node) {
+        mutex_lock_t *mutex = (mutex_lock_t *)obj;
+        if (mutex->pid == pid) {
+            mutex_release(mutex);
+        }
+    }
+    handle_for_each(obj, &rwlock_table, bucket, node) {
+        rwlock_t *rw = (rwlock_t *)obj;
+        if (rw->writer == pid) {
+            rwlock_release(rw, pid);
+        }
+    }
+    spin_lock_release(&ipc_lock);
+}
+
+void init_barriers() {
+    handle_table_init(&barrier_table, sizeof(barrier_t));
+}
+
 int do_barrier_init(int key, int goal) {
-    int bar_idx = key % BARRIER_NUM;
-    barriers[bar_idx].key = key;
-    barriers[bar_idx].goal = goal;
+    int created;
 
-    return bar_idx;
+    spin_lock_acquire(&ipc_lock);
+    barrier_t *bar = (barrier_t *)handle_open(&barrier_table, key, &created);
+    if (bar != NULL && created) {
+        INIT_LIST_HEAD(&bar->block_list);
+    }
+    if (bar != NULL) bar->goal = goal;
+    int handle = bar != NULL ? bar->obj.handle : -1;
+    spin_lock_release(&ipc_lock);
+
+    return handle;
 }
 
 void do_barrier_wait(int bar_idx) {
-    barrier_t *bar = &barriers[bar_idx];
-    
+    spin_lock_acquire(&ipc_lock);
+    barrier_t *bar = get_barrier(bar_idx);
+    if (bar == NULL) {
+        spin_lock_release(&ipc_lock);
+        return;
+    }
+
     bar->current++;
     if (bar->current < bar->goal) {
-        do_block(&current_running->list, &bar->block_list);
+        do_block(&current_running->list, &bar->block_list, &ipc_lock);
     } else {
         while (!is_queue_empty(&bar->block_list)) {
             do_unblock(bar->block_list.next);
         }
         bar->current = 0;
     }
+    spin_lock_release(&ipc_lock);
 }
 
+// the last reference lets the waiters go and frees the barrier
 void do_barrier_destroy(int bar_idx) {
-    barrier_t *bar = &barriers[bar_idx];
-    bar->current = 0, bar->current = 0, bar->key = 0;
-    while (!is_queue_empty(&bar->block_list)) {
-        list_delete_entry(bar->block_list.next);
+    spin_lock_acquire(&ipc_lock);
+    barrier_t *bar = get_barrier(bar_idx);
+    if (bar != NULL && --bar->obj.ref <= 0) {
+        while (!is_queue_empty(&bar->block_list)) {
+            do_unblock(bar->block_list.next);
+        }
+        handle_free(&barrier_table, &bar->obj);
     }
+    spin_lock_release(&ipc_lock);
 }
 
 void init_conditions() {
-    for (int i = 0; i < CONDITION_NUM; i++) {
-        conditions[i].key = 0;
-        INIT_LIST_HEAD(&conditions[i].wait_list);
-    }
+    handle_table_init(&condition_table, sizeof(condition_t));
 }
 
 int do_condition_init(int key) {
-    int idx = key % CONDITION_NUM;
-    conditions[idx].key = key;
-    return idx;
+    int created;
+
+    spin_lock_acquire(&ipc_lock);
+    condition_t *cond = (condition_t *)handle_open(&condition_table, key, &created);
+    if (cond != NULL && created) {
+        INIT_LIST_HEAD(&cond->wait_list);
+    }
+    int handle = cond != NULL ? cond->obj.handle : -1;
+    spin_lock_release(&ipc_lock);
+
+    return handle;
 }
 
+// the mutex is released and the task queued under one hold of
+// ipc_lock, so a signal between the two cannot be lost. the task
+// owns the mutex again once it is woken up, see cond_wake_waiter.
+// the waiter holds a reference to the mutex, which is unlocked while
+// it sleeps and would be freed by the last destroy otherwise
 void do_condition_wait(int cond_idx, int mutex_idx) {
-    condition_t *cond = &conditions[cond_idx];
-    do_mutex_lock_release(mutex_idx);
-    do_block(&current_running->list, &cond->wait_list);
-    do_mutex_lock_acquire(mutex_idx);
+    spin_lock_acquire(&ipc_lock);
+    condition_t *cond = get_condition(cond_idx);
+    mutex_lock_t *mutex = get_mutex(mutex_idx);
+
+    if (cond != NULL && mutex != NULL) {
+        mutex_release(mutex);
+        mutex->obj.ref++;
+        current_running->cond_mutex = mutex;
+        do_block(&current_running->list, &cond->wait_list, &ipc_lock);
+    }
+    spin_lock_release(&ipc_lock);
+}
+
+// wait morphing: a signaled waiter is handed its mutex if it is free,
+// or else moved onto the queue of the mutex without waking up, and the
+// owner hands the mutex over later. a waiter is only made ready once it
+// owns the mutex, a broadcast does not wake up a herd that blocks on
+// the mutex again at once
+static void cond_wake_waiter(list_head *wait_list) {
+    pcb_t *p = list_entry(wait_list->next, pcb_t);
+    mutex_lock_t *mutex = p->cond_mutex;
+    p->cond_mutex = NULL;
+
+    if (spin_lock_try_acquire(&mutex->lock) == UNLOCKED) {
+        mutex_set_owner(mutex, p);
+        do_unblock(&p->list);
+    } else {
+        list_delete_entry(&p->list);
+        list_add_tail(&p->list, &mutex->block_queue);
+        p->pi_blocked_on = mutex;
+        pi_boost(mutex, waiter_pi_nice(p));
+    }
+
+    // the mutex is locked either way, this only drops the reference
+    mutex->obj.ref--;
+    mutex_put(mutex);
+}
+
+// `p` is killed in a condition wait: drop its reference to the mutex
+// it would have got back
+void cancel_cond_wait(pcb_t *p)
+{
+    mutex_lock_t *mutex = p->cond_mutex;
+    if (mutex == NULL) return;
+
+    p->cond_mutex = NULL;
+    mutex->obj.ref--;
+    mutex_put(mutex);
 }
 
 void do_condition_signal(int cond_idx) {
-    condition_t *cond = &conditions[cond_idx];
-    if (!is_queue_empty(&cond->wait_list)) {
-        list_node_t *gonna_unblock = cond->wait_list.next;
-        do_unblock(gonna_unblock);
+    spin_lock_acquire(&ipc_lock);
+    condition_t *cond = get_condition(cond_idx);
+    if (cond != NULL && !is_queue_empty(&cond->wait_list)) {
+        cond_wake_waiter(&cond->wait_list);
     }
+    spin_lock_release(&ipc_lock);
 }
 
 void do_condition_broadcast(int cond_idx) {
-    condition_t *cond = &conditions[cond_idx];
-    while (!is_queue_empty(&cond->wait_list)) {
-        list_node_t *gonna_unblock = cond->wait_list.next;
-        do_unblock(gonna_unblock);
+    spin_lock_acquire(&ipc_lock);
+    condition_t *cond = get_condition(cond_idx);
+    while (cond != NULL && !is_queue_empty(&cond->wait_list)) {
+        cond_wake_waiter(&cond->wait_list);
     }
+    spin_lock_release(&ipc_lock);
 }
 
+// the last reference lets the waiters go and frees the condition
 void do_condition_destroy(int cond_idx) {
-    condition_t *cond = &conditions[cond_idx];
-    cond->key = 0;
-    while (!is_queue_empty(&cond->wait_list)) {
-        list_node_t *gonna_unblock = cond->wait_list.next;
-        do_unblock(gonna_unblock);
+    spin_lock_acquire(&ipc_lock);
+    condition_t *cond = get_condition(cond_idx);
+    if (cond != NULL && --cond->obj.ref <= 0) {
+        while (!is_queue_empty(&cond->wait_list)) {
+            cond_wake_waiter(&cond->wait_list);
+        }
+        handle_free(&condition_table, &cond->obj);
     }
+    spin_lock_release(&ipc_lock);
 }
 
-void init_mbox() {
-    for (int i = 0; i < MBOX_NUM; i++) {
-        mailbox_t *mbox = &mailboxes[i];
-        bzero(mbox->name, 32);
-        bzero(mbox->buf, MAX_MBOX_LENGTH);
+void init_rwlocks(void)
+{
+    handle_table_init(&rwlock_table, sizeof(rwlock_t));
+}
+
+int do_rwlock_init(int key, int flags)
+{
+    int created;
+
+    spin_lock_acquire(&ipc_lock);
+    rwlock_t *rw = (rwlock_t *)handle_open(&rwlock_table, key, &created);
+    if (rw != NULL && created) {
+        rw->flags = flags;
+        INIT_LIST_HEAD(&rw->read_queue);
+        INIT_LIST_HEAD(&rw->write_queue);
+    }
+    int handle = rw != NULL ? rw->obj.handle : -1;
+    spin_lock_release(&ipc_lock);
+
+    return handle;
+}
+
+// free an rwlock nobody refers to once nobody holds or waits for it
+static void rwlock_put(rwlock_t *rw)
+{
+    if (rw->obj.ref == 0 && rw->readers == 0 && rw->writer == 0 &&
+        is_queue_empty(&rw->read_queue) && is_queue_empty(&rw->write_queue)) {
+        handle_free(&rwlock_table, &rw->obj);
+    }
+}
+
+static inline int rwlock_writer_waits(rwlock_t *rw)
+{
+    return (rw->flags & RWLOCK_PREFER_WRITER) && !is_queue_empty(&rw->write_queue);
+}
 
-        mbox->ref = 0, mbox->nread = 0, mbox->nwrite = 0;
-        mbox->round_read = 0, mbox->round_write = 0;
-        mbox->mutex_id = -1;
-        INIT_LIST_HEAD(&mbox->send_list);
-        INIT_LIST_HEAD(&mbox->recv_list);
+// the rwlock is held only while a reader or writer is let in, readers
+// on different cpus then run their read sections at the same time.
+// a woken task checks again, another one may have got in before it
+void do_rwlock_rdlock(int rw_idx)
+{
+    spin_lock_acquire(&ipc_lock);
+    rwlock_t *rw = get_rwlock(rw_idx);
+    if (rw == NULL) {
+        spin_lock_release(&ipc_lock);
+        return;
     }
+
+    while (rw->writer != 0 || rwlock_writer_waits(rw)) {
+        do_block(&current_running->list, &rw->read_queue, &ipc_lock);
+    }
+    rw->readers++;
+    spin_lock_release(&ipc_lock);
 }
 
-int do_mbox_open(char *name) {
+void do_rwlock_wrlock(int rw_idx)
+{
+    spin_lock_acquire(&ipc_lock);
+    rwlock_t *rw = get_rwlock(rw_idx);
+    if (rw == NULL) {
+        spin_lock_release(&ipc_lock);
+        return;
+    }
+
+    while (rw->writer != 0 || rw->readers != 0) {
+        do_block(&current_running->list, &rw->write_queue, &ipc_lock);
+    }
+    rw->writer = current_running->pid;
+    spin_lock_release(&ipc_lock);
+}
+
+// called with ipc_lock held. once the rwlock is free, a writer is woken
+// up if writers are preferred or no reader waits, else all readers
+static void rwlock_release(rwlock_t *rw, pid_t pid)
+{
+    if (rw->writer != 0 && rw->writer == pid) {
+        rw->writer = 0;
+    } else if (rw->readers > 0) {
+        rw->readers--;
+    }
+    if (rw->writer != 0 || rw->readers != 0) return;
+
+    if (rwlock_writer_waits(rw) || is_queue_empty(&rw->read_queue)) {
+        if (!is_queue_empty(&rw->write_queue)) {
+            do_unblock(rw->write_queue.next);
+        }
+    } else {
+        while (!is_queue_empty(&rw->read_queue)) {
+            do_unblock(rw->read_queue.next);
+        }
+    }
+}
+
+// releases the write hold of the caller's process, or else a read hold
+void do_rwlock_unlock(int rw_idx)
+{
+    spin_lock_acquire(&ipc_lock);
+    rwlock_t *rw = get_rwlock(rw_idx);
+    if (rw != NULL) {
+        rwlock_release(rw, current_running->pid);
+        rwlock_put(rw);
+    }
+    spin_lock_release(&ipc_lock);
+}
+
+// drop a reference to the rwlock, return 0 for a stale handle
+int do_rwlock_destroy(int rw_idx)
+{
+    spin_lock_acquire(&ipc_lock);
+    rwlock_t *rw = get_rwlock(rw_idx);
+    if (rw != NULL && rw->obj.ref > 0) {
+        rw->obj.ref--;
+        rwlock_put(rw);
+    }
+    spin_lock_release(&ipc_lock);
+
+    return rw != NULL;
+}
+
+void init_mbox() {
+    handle_table_init(&mbox_table, sizeof(mailbox_t));
+}
+
+static uint32_t name_hash(char *name) {
+    uint32_t hash = 5381;
+    while (*name) hash = hash * 33 + *name++;
+    return hash;
+}
+
+// the mailbox called `name`, created with room for `capacity` bytes
+// (rounded up to a power of two, MAX_MBOX_LENGTH if <= 0) if there
+// is none. an existing mailbox keeps its capacity
+int do_mbox_open(char *name, int capacity) {
     mailbox_t *mbox = NULL;
-    int mbox_idx = -1;
+    uint32_t hash = name_hash(name);
+
+    if (capacity <= 0) capacity = MAX_MBOX_LENGTH;
+    if (capacity > MBOX_MAX_CAPACITY) return -1;
+
+    spin_lock_acquire(&ipc_lock);
 
     // try to find a mailbox with given name
-    for (int i = 0; i < MBOX_NUM; i++) {
-        if (strcmp(name, mailboxes[i].name) == 0) {
-            mbox = &mailboxes[i];
-            mbox_idx = i;
+    list_head *bucket = handle_bucket(&mbox_table, hash);
+    for (list_node_t *node = bucket->next; node != bucket; node = node->next) {
+        mailbox_t *m = (mailbox_t *)list_entry_of(node, handle_obj_t, hash_node);
+        if (m->obj.hash == hash && strcmp(name, m->name) == 0) {
+            mbox = m;
+            mbox->obj.ref++;
             break;
         }
     }
 
-    // mailbox with given name not found
-    // find a mbox not used
+    // mailbox with given name not found, create it
     if (mbox == NULL) {
-        for (int i = 0; i < MBOX_NUM; i++) {
-            if (mailboxes[i].ref == 0) {
-                mbox = &mailboxes[i];
-                mbox_idx = i;
-                strcpy(mbox->name, name);
-
-                // find a mutex for this mailbox
-                mbox->mutex_id = mbox_idx;
-                break;
-            }
+        mbox = (mailbox_t *)handle_alloc(&mbox_table, hash);
+        if (mbox != NULL) {
+            strncpy(mbox->name, name, MBOX_NAME_LEN - 1);
+            mbox->buf = (char *)kalloc();
+            mbox->capacity = 1;
+            while (mbox->capacity < capacity) mbox->capacity <<= 1;
+            INIT_LIST_HEAD(&mbox->send_list);
+            INIT_LIST_HEAD(&mbox->recv_list);
+            INIT_LIST_HEAD(&mbox->page_msgs);
+            INIT_LIST_HEAD(&mbox->page_waiters);
         }
     }
-    
-    // cannot not find a mbox not used
-    // open mailbox failed, return -1
-    if (mbox == NULL) {
-        return -1;
-    }
 
-    mbox->ref++;
+    // out of handles, open mailbox failed, return -1
+    int mbox_idx = mbox != NULL ? mbox->obj.handle : -1;
+    spin_lock_release(&ipc_lock);
     return mbox_idx;
 }
 
+// free a page message nobody will receive
+static void mbox_drop_pages(mbox_pages_t *msg) {
+    spin_lock_acquire(&mm_lock);
+    for (int i = 0; i < msg->npages; i++) {
+        page_drop(msg->pages[i]);
+    }
+    spin_lock_release(&mm_lock);
+    kfree((uint64_t)msg);
+}
+
 void do_mbox_close(int mbox_idx) {
-    mailbox_t *mbox = &mailboxes[mbox_idx];
-    mbox->ref--;
+    spin_lock_acquire(&ipc_lock);
+    mailbox_t *mbox = get_mbox(mbox_idx);
 
     // no process is using this mailbox, release it
-    if (mbox->ref == 0) {
-        bzero(mbox->name, 32);
-        bzero(mbox->buf, MAX_MBOX_LENGTH);
+    if (mbox != NULL && --mbox->obj.ref <= 0) {
+        while (!is_queue_empty(&mbox->page_msgs)) {
+            mbox_pages_t *msg = list_entry_of(mbox->page_msgs.next, mbox_pages_t, list);
+            list_delete_entry(&msg->list);
+            mbox_drop_pages(msg);
+        }
+        kfree((uint64_t)mbox->buf);
+        handle_free(&mbox_table, &mbox->obj);
+    }
+    spin_lock_release(&ipc_lock);
+}
 
-        do_mutex_lock_release(mbox->mutex_id);
-        mbox->mutex_id = -1;
-        mbox->nread = 0, mbox->nwrite = 0;
-        mbox->round_read = 0, mbox->round_write = 0;
+static inline uint32_t mbox_used(mailbox_t *mbox) {
+    return mbox->tail - mbox->head;
+}
+
+// wake up the tasks of `queue` in order for as long as the `avail`
+// bytes cover what they wait for. the rest would find nothing to do
+// and block again, the first one which does not fit holds back the
+// ones behind it so that a long message is not starved by short ones.
+// the one which waited longest is remembered as the partner of
+// current_running, by id as it may exit before it is handed the cpu
+static void wake_up_partners(list_head *queue, uint32_t avail) {
+    pcb_t *first = NULL;
+
+    while (!is_queue_empty(queue)) {
+        pcb_t *p = list_entry(queue->next, pcb_t);
+        if (p->mbox_want > avail) break;
+
+        avail -= p->mbox_want;
+        if (first == NULL) first = p;
+        do_unblock(&p->list);
+    }
+    if (first != NULL) {
+        current_running->wakee_pid = first->pid;
+        current_running->wakee_tid = first->tid;
     }
 }
 
-static int can_write_to_buffer(mailbox_t *mbox, int msg_len) {
-    int written = (mbox->round_write - mbox->round_read) * MAX_MBOX_LENGTH + (mbox->nwrite - mbox->nread);
-    return msg_len + written <= MAX_MBOX_LENGTH;
+// block in `queue` waiting for `want` bytes and hand the cpu to the
+// partner woken up last, which is about to do the work current_running
+// is waiting for
+static void block_for_partner(list_head *queue, int want) {
+    pid_t pid = current_running->wakee_pid;
+    pthread_t tid = current_running->wakee_tid;
+    current_running->wakee_pid = 0;
+    current_running->mbox_want = want;
+    do_block_to(&current_running->list, queue, &ipc_lock, pid, tid);
 }
 
-static int can_read_from_buffer(mailbox_t *mbox, int msg_len) {
-    int written = (mbox->round_write - mbox->round_read) * MAX_MBOX_LENGTH + (mbox->nwrite - mbox->nread);
-    return written >= msg_len;
+// copy between `msg` and the ring at `pos`, in two parts if it wraps
+static void mbox_copy(mailbox_t *mbox, uint32_t pos, char *msg, uint32_t len, int to_ring) {
+    uint32_t off   = pos & (mbox->capacity - 1);
+    uint32_t first = len < mbox->capacity - off ? len : mbox->capacity - off;
+
+    if (to_ring) {
+        memcpy((uint8_t *)mbox->buf + off, (uint8_t *)msg, first);
+        memcpy((uint8_t *)mbox->buf, (uint8_t *)msg + first, len - first);
+    } else {
+        memcpy((uint8_t *)msg, (uint8_t *)mbox->buf + off, first);
+        memcpy((uint8_t *)msg + first, (uint8_t *)mbox->buf, len - first);
+    }
 }
 
+// a message goes in as a whole, one longer than the mailbox
+// can never be sent and fails with -1 instead of blocking forever
 int do_mbox_send(int mbox_idx, void * msg, int msg_length) {
-    mailbox_t *mbox = &mailboxes[mbox_idx];
     int block_count = 0;
 
-    // first accquire the mutex
-    int mutex_id = mbox->mutex_id;
-    do_mutex_lock_acquire(mutex_id);
+    spin_lock_acquire(&ipc_lock);
+    mailbox_t *mbox = get_mbox(mbox_idx);
+    if (mbox == NULL || msg_length < 0 || msg_length > mbox->capacity) {
+        spin_lock_release(&ipc_lock);
+        return -1;
+    }
 
     // check if current running process can send message to the buffer
     // if not, block this process in send_list
-    while (!can_write_to_buffer(mbox, msg_length)) {
-        do_mutex_lock_release(mutex_id);
+    while (mbox->capacity - mbox_used(mbox) < msg_length) {
         block_count++;
-        do_block(&current_running->list, &mbox->send_list);
-        do_mutex_lock_acquire(mutex_id);
+        block_for_partner(&mbox->send_list, msg_length);
     }
 
-    // copy message to the buffer
-    for (int i = 0; i < msg_length; i++) {
-        mbox->buf[mbox->nwrite++] = *(char *)(msg + i);
-        if (mbox->nwrite >= MAX_MBOX_LENGTH) {
-            mbox->nwrite %= MAX_MBOX_LENGTH;
-            mbox->round_write++;
-        }
-    }
+    mbox_copy(mbox, mbox->tail, (char *)msg, msg_length, 1);
+    mbox->tail += msg_length;
 
-    // wakeup processes waiting on recv_list
-    while (!is_queue_empty(&mbox->recv_list)) {
-        do_unblock(mbox->recv_list.next);
-    }
+    // wakeup the receivers the message is enough for
+    wake_up_partners(&mbox->recv_list, mbox_used(mbox));
 
-    // release the mutex then return
-    do_mutex_lock_release(mutex_id);
+    spin_lock_release(&ipc_lock);
     return block_count;
 }
 
 int do_mbox_recv(int mbox_idx, void * msg, int msg_length) {
-    mailbox_t *mbox = &mailboxes[mbox_idx];
     int block_count = 0;
     
-    // first accquire the mutex
-    int mutex_id = mbox->mutex_id;
-    do_mutex_lock_acquire(mutex_id);
+    spin_lock_acquire(&ipc_lock);
+    mailbox_t *mbox = get_mbox(mbox_idx);
+    if (mbox == NULL || msg_length < 0 || msg_length > mbox->capacity) {
+        spin_lock_release(&ipc_lock);
+        return -1;
+    }
 
     // check if current running process can read message from the buffer
     // if not, block this process in recv_list
-    while (!can_read_from_buffer(mbox, msg_length)) {
-        do_mutex_lock_release(mutex_id);
+    while (mbox_used(mbox) < msg_length) {
         block_count++;
-        do_block(&current_running->list, &mbox->recv_list);
-        do_mutex_lock_acquire(mutex_id);
-    }
-
-    // read message from the buffer
-    char *msg_arr = (char *)msg;
-    for (int i = 0; i < msg_length; i++) {
-        msg_arr[i] = mbox->buf[mbox->nread++];
-        mbox->nread++;
-        if (mbox->nread >= MAX_MBOX_LENGTH) {
-            mbox->nread %= MAX_MBOX_LENGTH;
-            mbox->round_read++;
+        block_for_partner(&mbox->recv_list, msg_length);
+    }
+
+    mbox_copy(mbox, mbox->head, (char *)msg, msg_length, 0);
+    mbox->head += msg_length;
+
+    // wakeup the senders the freed room is enough for
+    wake_up_partners(&mbox->send_list, mbox->capacity - mbox_used(mbox));
+
+    spin_lock_release(&ipc_lock);
+    return block_count;
+}
+
+// send the `npages` pages at `addr` as one message without copying
+// them: they are unmapped from current_running and mapped into the
+// receiver. touching `addr` again gives fresh pages. return 0, or -1
+// if one of them is not a private page of current_running, or is
+// pinned by a futex waiter
+int do_mbox_send_pages(int mbox_idx, void *addr, int npages) {
+    uint64_t uva = (uint64_t)addr;
+    PTE *pgdir = current_running->pgdir;
+
+    if ((uva & (PAGE_SIZE - 1)) || npages <= 0 || npages > MBOX_PAGES_MAX) {
+        return -1;
+    }
+
+    spin_lock_acquire(&ipc_lock);
+    mailbox_t *mbox = get_mbox(mbox_idx);
+    if (mbox == NULL) {
+        spin_lock_release(&ipc_lock);
+        return -1;
+    }
+
+    // check them all first, a message is sent as a whole or not at all
+    spin_lock_acquire(&mm_lock);
+    for (int i = 0; i < npages; i++) {
+        if (!page_is_movable(uva + i * PAGE_SIZE, pgdir)) {
+            spin_lock_release(&mm_lock);
+            spin_lock_release(&ipc_lock);
+            return -1;
         }
     }
 
-    // wakeup processes waiting on send_list
-    while (!is_queue_empty(&mbox->send_list)) {
-        do_unblock(mbox->send_list.next);
+    mbox_pages_t *msg = (mbox_pages_t *)kalloc();
+    msg->npages = npages;
+    for (int i = 0; i < npages; i++) {
+        msg->pages[i] = page_detach(uva + i * PAGE_SIZE, pgdir);
     }
+    spin_lock_release(&mm_lock);
 
-    // release the mutex then return
-    do_mutex_lock_release(mutex_id);
-    return block_count;
+    list_add_tail(&msg->list, &mbox->page_msgs);
+    mbox->nr_page_msgs++;
+
+    // a receiver takes one message
+    wake_up_partners(&mbox->page_waiters, mbox->nr_page_msgs);
+
+    spin_lock_release(&ipc_lock);
+    return 0;
+}
+
+// map the pages of the next page message at `addr`, blocking until
+// one comes. private pages mapped there before are freed. return the
+// number of pages, or -1 if the message is longer than `npages` (it
+// stays queued) or `addr` has other memory mapped, shared or pinned
+int do_mbox_recv_pages(int mbox_idx, void *addr, int npages) {
+    uint64_t uva = (uint64_t)addr;
+    PTE *pgdir = current_running->pgdir;
+
+    if ((uva & (PAGE_SIZE - 1)) || npages <= 0) return -1;
+
+    spin_lock_acquire(&ipc_lock);
+    mailbox_t *mbox = get_mbox(mbox_idx);
+    if (mbox == NULL) {
+        spin_lock_release(&ipc_lock);
+        return -1;
+    }
+
+    while (mbox->nr_page_msgs == 0) {
+        block_for_partner(&mbox->page_waiters, 1);
+    }
+
+    mbox_pages_t *msg = list_entry_of(mbox->page_msgs.next, mbox_pages_t, list);
+    int ret = msg->npages;
+
+    spin_lock_acquire(&mm_lock);
+    for (int i = 0; i < msg->npages && ret > 0; i++) {
+        uint64_t va = uva + i * PAGE_SIZE;
+        if (get_pte_of_uva(va, pgdir) != NULL && !page_is_movable(va, pgdir)) {
+            ret = -1;
+        }
+    }
+    if (msg->npages > npages) ret = -1;
+
+    if (ret > 0) {
+        for (int i = 0; i < msg->npages; i++) {
+            uint64_t va = uva + i * PAGE_SIZE;
+            if (get_pte_of_uva(va, pgdir) != NULL) {
+                page_drop(page_detach(va, pgdir));
+            }
+            page_attach(msg->pages[i], va, pgdir);
+        }
+    }
+    spin_lock_release(&mm_lock);
+
+    if (ret > 0) {
+        list_delete_entry(&msg->list);
+        mbox->nr_page_msgs--;
+        kfree((uint64_t)msg);
+    }
+
+    spin_lock_release(&ipc_lock);
+    return ret;
 }
@@ -0,0 +1,40 @@
+#include <os/lock.h>
+#include <os/mm.h>
+#include <atomic.h>
+
+// MCS queued spinlock: `tail` is the last waiter in the queue, a cpu
+// appends its node with one swap and then spins on its own node only,
+// until the one in front of it hands the lock over
+
+void mcs_lock_init(mcs_lock_t *lock)
+{
+    lock->tail = NULL;
+}
+
+void mcs_lock_acquire(mcs_lock_t *lock, mcs_node_t *node)
+{
+    node->next   = NULL;
+    node->locked = 1;
+
+    mcs_node_t *prev = (mcs_node_t *)atomic_swap_d((uint64_t)node, (ptr_t)&lock->tail);
+    if (prev != NULL) {
+        prev->next = node;
+        while (node->locked) {
+            mm_shootdown_ack();
+        }
+    }
+    smp_mb();
+}
+
+void mcs_lock_release(mcs_lock_t *lock, mcs_node_t *node)
+{
+    smp_mb();
+    if (node->next == NULL) {
+        // nobody behind us, the queue is empty again
+        if (atomic_cmpxchg_d((uint64_t)node, 0, (ptr_t)&lock->tail) == (uint64_t)node) return;
+
+        // a waiter swapped itself in but has not linked its node yet
+        while (node->next == NULL);
+    }
+    node->next->locked = 0;
+}
@@ -0,0 +1,284 @@
+#include <os/mm.h>
+#include <os/sched.h>
+#include <os/smp.h>
+#include <os/lock.h>
+#include <os/string.h>
+#include <pgtable.h>
+#include <atomic.h>
+#include <assert.h>
+
+// address space ids: a user pgdir gets an ASID of the current generation
+// the first time it is loaded, so a switch between processes only writes
+// satp and keeps the TLB. when a generation runs out of ASIDs a new one
+// starts and every cpu flushes its whole TLB once before loading a pgdir.
+// ASID 0 is the kernel pagetable. the idle pcb runs on whatever pgdir is
+// loaded, whose kernel half is the same in all pgdirs.
+
+#define ASID_MASK ((1lu << asid_bits) - 1)
+#define MM_HASH_SIZE 64
+
+// allocated with its pgdir by `alloc_pgdir` and hashed by it
+typedef struct mm_context
+{
+    PTE *pgdir;
+    uint64_t asid;          /* generation | asid, 0 before it is loaded */
+    uint32_t stale_cpus;    /* cpus whose TLB may hold changed mappings */
+    int dying;              /* freed, but still loaded on some cpu */
+    list_node_t hash_node;
+} mm_context_t;
+
+static slab_cache_t mm_cache;
+static list_head mm_hash[MM_HASH_SIZE];
+
+static int asid_bits;
+static uint64_t asid_generation;
+static uint64_t asid_next;
+
+// cpus which must flush the whole TLB before they load a pgdir
+static uint32_t flush_pending;
+
+// pgdir loaded on each cpu and the ASID it was loaded with
+static PTE *active_pgdir[NR_CPUS];
+static uint64_t active_asid[NR_CPUS];
+
+// all of the state above, taken by the three functions at the bottom
+spin_lock_t asid_lock;
+
+// cpus asked to flush their TLB by `mm_flush_page`, which waits for
+// them to clear their bit. not under asid_lock: a cpu acks from its
+// IPI handler and while it spins on any lock, see `mm_shootdown_ack`
+static volatile uint32_t shootdown_pending;
+
+void init_asid(void)
+{
+    // the ASID bits a hart does not implement read back as 0
+    uint64_t satp, probe;
+    asm volatile("csrr %0, satp" : "=r"(satp));
+    asm volatile("csrw satp, %0" : : "r"(satp | (0xfffflu << SATP_ASID_SHIFT)));
+    asm volatile("csrr %0, satp" : "=r"(probe));
+    asm volatile("csrw satp, %0" : : "r"(satp));
+
+    probe = (probe >> SATP_ASID_SHIFT) & 0xffff;
+    for (asid_bits = 0; probe & (1lu << asid_bits); asid_bits++);
+
+    asid_generation = 1lu << asid_bits;
+    asid_next = 1;
+
+    for (int i = 0; i < NR_CPUS; i++) {
+        active_pgdir[i] = (PTE *)PGDIR_VA;
+        active_asid[i]  = 0;
+    }
+
+    slab_cache_init(&mm_cache, sizeof(mm_context_t));
+    for (int i = 0; i < MM_HASH_SIZE; i++) {
+        INIT_LIST_HEAD(&mm_hash[i]);
+    }
+}
+
+static inline list_head *mm_bucket(PTE *pgdir)
+{
+    return &mm_hash[((uint64_t)pgdir >> NORMAL_PAGE_SHIFT) % MM_HASH_SIZE];
+}
+
+// the context of a user pgdir, NULL for the kernel pagetable
+static mm_context_t *find_mm_context(PTE *pgdir)
+{
+    list_head *bucket = mm_bucket(pgdir);
+    for (list_node_t *node = bucket->next; node != bucket; node = node->next) {
+        mm_context_t *mm = list_entry_of(node, mm_context_t, hash_node);
+        if (mm->pgdir == pgdir) return mm;
+    }
+    return NULL;
+}
+
+static void free_mm_context(mm_context_t *mm)
+{
+    list_delete_entry(&mm->hash_node);
+    slab_free(&mm_cache, mm);
+}
+
+// a new, cleared user pgdir and its context
+PTE *alloc_pgdir(void)
+{
+    PTE *pgdir = (PTE *)kalloc();
+
+    spin_lock_acquire(&asid_lock);
+    mm_context_t *mm = (mm_context_t *)slab_alloc(&mm_cache);
+    mm->pgdir      = pgdir;
+    mm->asid       = 0;
+    mm->stale_cpus = 0;
+    mm->dying      = 0;
+    list_add_tail(&mm->hash_node, mm_bucket(pgdir));
+    spin_lock_release(&asid_lock);
+
+    return pgdir;
+}
+
+static void new_asid(mm_context_t *mm)
+{
+    if (asid_next > ASID_MASK) {
+        asid_generation += 1lu << asid_bits;
+        asid_next = 1;
+        flush_pending = CPU_MASK_ALL;
+    }
+    mm->asid = asid_generation | asid_next++;
+}
+
+static int is_loaded_elsewhere(PTE *pgdir, int cpu)
+{
+    for (int i = 0; i < NR_CPUS; i++) {
+        if (i != cpu && active_pgdir[i] == pgdir) return 1;
+    }
+    return 0;
+}
+
+// free a pgdir which was released while it was loaded
+static void free_dying_pgdir(PTE *pgdir, int cpu)
+{
+    mm_context_t *mm = find_mm_context(pgdir);
+    if (mm == NULL || !mm->dying || is_loaded_elsewhere(pgdir, cpu)) return;
+
+    free_mm_context(mm);
+    memset(pgdir, 0, PAGE_SIZE);
+    kfree((uint64_t)pgdir);
+}
+
+// load `pgdir` on this cpu, a switch to the kernel pagetable (the
+// idle pcb) or to the pgdir already loaded (another thread of the same
+// process) neither writes satp nor flushes the TLB
+void switch_mm(PTE *pgdir)
+{
+    int cpu = get_current_cpu_id();
+    uint32_t cpu_bit = 1u << cpu;
+    PTE *prev = active_pgdir[cpu];
+
+    if (pgdir == (PTE *)PGDIR_VA) return;
+
+    spin_lock_acquire(&asid_lock);
+    mm_context_t *mm = find_mm_context(pgdir);
+    assert(mm != NULL);
+
+    if (pgdir == prev) {
+        // mappings changed since this cpu loaded it
+        if (mm->stale_cpus & cpu_bit) {
+            local_flush_tlb_asid(active_asid[cpu]);
+            mm->stale_cpus &= ~cpu_bit;
+        }
+        spin_lock_release(&asid_lock);
+        return;
+    }
+
+    uint64_t asid = 0;
+    if (asid_bits == 0) {
+        local_flush_tlb_all();
+    } else {
+        if ((mm->asid & ~ASID_MASK) != asid_generation) {
+            new_asid(mm);
+        }
+        asid = mm->asid & ASID_MASK;
+
+        if (flush_pending & cpu_bit) {
+            local_flush_tlb_all();
+            flush_pending &= ~cpu_bit;
+        } else if (mm->stale_cpus & cpu_bit) {
+            local_flush_tlb_asid(asid);
+        }
+    }
+    mm->stale_cpus &= ~cpu_bit;
+
+    switch_satp(SATP_MODE_SV39, asid, kva2pa((uintptr_t)pgdir) >> NORMAL_PAGE_SHIFT);
+    active_pgdir[cpu] = pgdir;
+    active_asid[cpu]  = asid;
+
+    free_dying_pgdir(prev, cpu);
+    spin_lock_release(&asid_lock);
+}
+
+// flush the TLB of this cpu if `mm_flush_page` asked it to. called
+// from the IPI handler, and from the spin loops of the locks: a cpu
+// spinning with interrupts off, maybe on a lock held by the cpu which
+// waits for it, still acks. takes no lock itself
+void mm_shootdown_ack(void)
+{
+    uint32_t cpu_bit = 1u << get_current_cpu_id();
+
+    if (shootdown_pending & cpu_bit) {
+        local_flush_tlb_all();
+        atomic_fetch_and(~cpu_bit, (ptr_t)&shootdown_pending);
+    }
+}
+
+// a mapping of `uva` in `pgdir` changed: flush it from this cpu if the
+// pgdir is loaded here and other cpus flush the ASID when they load it
+// next. a cpu which has it loaded right now is sent an IPI and waited
+// for, the caller may free or reuse the old page as soon as this returns
+void mm_flush_page(PTE *pgdir, uint64_t uva)
+{
+    spin_lock_acquire(&asid_lock);
+    mm_context_t *mm = find_mm_context(pgdir);
+
+    // the kernel pagetable, whose mappings do not change
+    if (mm == NULL) {
+        spin_lock_release(&asid_lock);
+        return;
+    }
+
+    int cpu = get_current_cpu_id();
+    mm->stale_cpus = CPU_MASK_ALL;
+
+    if (active_pgdir[cpu] == pgdir) {
+        if (asid_bits == 0) {
+            local_flush_tlb_page(uva);
+        } else {
+            local_flush_tlb_page_asid(uva, active_asid[cpu]);
+        }
+        mm->stale_cpus &= ~(1u << cpu);
+    }
+
+    // a cpu loading the pgdir from now on sees it stale and flushes
+    uint32_t targets = 0;
+    for (int i = 0; i < NR_CPUS; i++) {
+        if (i != cpu && active_pgdir[i] == pgdir) targets |= 1u << i;
+    }
+    spin_lock_release(&asid_lock);
+
+    if (targets == 0) return;
+
+    atomic_fetch_or(targets, (ptr_t)&shootdown_pending);
+    for (int i = 0; i < NR_CPUS; i++) {
+        if (targets & (1u << i)) send_resched_ipi(i);
+    }
+
+    // two cpus may shoot at each other, ack ours while waiting
+    while (shootdown_pending & targets) {
+        mm_shootdown_ack();
+    }
+}
+
+// the process of `pgdir` is gone, return 1 if the pgdir can be freed,
+// or 0 if another cpu still has it loaded and frees it when it switches
+int mm_release(PTE *pgdir)
+{
+    int cpu = get_current_cpu_id();
+    int can_free = 1;
+
+    spin_lock_acquire(&asid_lock);
+
+    // this cpu runs the idle pcb on it, fall back to the kernel pagetable
+    if (active_pgdir[cpu] == pgdir) {
+        switch_satp(SATP_MODE_SV39, 0, PGDIR_PA >> NORMAL_PAGE_SHIFT);
+        active_pgdir[cpu] = (PTE *)PGDIR_VA;
+        active_asid[cpu]  = 0;
+    }
+
+    mm_context_t *mm = find_mm_context(pgdir);
+    if (mm != NULL && is_loaded_elsewhere(pgdir, cpu)) {
+        mm->dying = 1;
+        can_free = 0;
+    } else if (mm != NULL) {
+        free_mm_context(mm);
+    }
+
+    spin_lock_release(&asid_lock);
+    return can_free;
+}
@@ -4,11 +4,18 @@
 #include <os/string.h>
 #include <os/list.h>
 #include <os/kernel.h>
+#include <os/lock.h>
 #include <pgtable.h>
 #include <assert.h>
 
 // free memory list
 freemem_t *freemem_list;
+mcs_lock_t kalloc_lock;
+
+// user pages: the page queues, swap and share pages below, and the
+// user pagetables. the functions touching them expect mm_lock held,
+// except `shm_page_get` and `shm_page_dt` whose syscalls take it
+spin_lock_t mm_lock;
 
 void init_kernel_freemem() {
     freemem_list = (freemem_t *)FREEMEM_KERNEL;
@@ -17,6 +24,8 @@ void init_kernel_freemem() {
 
 void *kalloc()
 {
+    mcs_node_t node;
+    mcs_lock_acquire(&kalloc_lock, &node);
     freemem_t *mem = freemem_list;
     if (freemem_list->next == NULL) {
         freemem_list = (freemem_t *)((uint64_t)freemem_list + PAGE_SIZE);
@@ -24,6 +33,7 @@ void *kalloc()
     } else {
         freemem_list = freemem_list->next;        
     }
+    mcs_lock_release(&kalloc_lock, &node);
 
     memset(mem, 0, PAGE_SIZE);
     return mem;
@@ -36,8 +46,11 @@ void kfree(uint64_t base_addr)
     if ((uint64_t)base_addr < FREEMEM_KERNEL) return;
 
     freemem_t *free_page = (freemem_t *)base_addr;
+    mcs_node_t node;
+    mcs_lock_acquire(&kalloc_lock, &node);
     free_page->next = freemem_list;
     freemem_list = free_page;
+    mcs_lock_release(&kalloc_lock, &node);
 }
 
 /* free a three-level user pagetable */
@@ -70,7 +83,10 @@ void free_pagetable(PTE *pgdir) {
 }
 
 // clear & free pagetable directory(1-st level pagetable)
+// a pgdir still loaded on another cpu is freed by that cpu later
 void free_pgdir(PTE *pgdir) {
+    if (!mm_release(pgdir)) return;
+
     memset(pgdir, 0, PAGE_SIZE);
     kfree((uint64_t)pgdir);
 }
@@ -110,6 +126,7 @@ void map_uva_to_kva(uint64_t uva, uint64_t kva, PTE *pgdir) {
     set_pfn(&pte[vpn0], kva2pa(kva) >> NORMAL_PAGE_SHIFT);
     set_attribute(&pte[vpn0], _PAGE_PRESENT | _PAGE_READ | _PAGE_WRITE |
                         _PAGE_EXEC | _PAGE_USER);
+    mm_flush_page(pgdir, uva);
 }
 
 /* allocate physical page for `va`, mapping it into `pgdir`,
@@ -191,10 +208,18 @@ void add_new_pre_page(uint64_t uva, uint64_t kva, PTE *pgdir) {
     present_pages_num++;
 }
 
-// swap algorithm: FIFO
+// swap algorithm: FIFO, skipping pinned pages
 void swap_out() {
+    page_t *swapped_page = NULL, *page;
+    list_for_each_entry(page, &present_pages_queue) {
+        if (page->pin == 0) {
+            swapped_page = page;
+            break;
+        }
+    }
+    assert(swapped_page != NULL);
+
     // move swapped page to swapped_pages_queue
-    page_t *swapped_page = list_entry(present_pages_queue.next, page_t);
     list_delete_entry(&swapped_page->list);
     list_add_tail(&swapped_page->list, &swapped_pages_queue);
 
@@ -208,6 +233,7 @@ void swap_out() {
     // then free the memory the page is holding
     PTE *pte = get_pte_of_uva(swapped_page->uva, swapped_page->pgdir);
     unset_attribute(pte, _PAGE_PRESENT);
+    mm_flush_page(swapped_page->pgdir, swapped_page->uva);
     kfree(swapped_page->kva);
 
     present_pages_num--;
@@ -264,6 +290,38 @@ page_t *find_page_with_kva(uint64_t kva, list_head *queue) {
 static void reset_page_info(page_t *page) {
     page->page_id = 0, page->sector_id = 0;
     page->uva     = 0, page->kva = 0;
+    page->pin     = 0;
+}
+
+// make the page of `uva` present as a page fault would: allocate it if
+// it was never touched, or swap it in. return the kva of `uva`
+uint64_t page_fault_in(uint64_t uva, PTE *pgdir) {
+    uint64_t uva_aligned = uva & ~((uint64_t)PAGE_SIZE - 1);
+    PTE *pte = get_pte_of_uva(uva_aligned, pgdir);
+
+    if (pte == NULL) {
+        alloc_page_helper(uva_aligned, pgdir);
+    } else if (!(*pte & _PAGE_PRESENT)) {
+        page_t *page = find_page_with_uva(uva_aligned, pgdir, &swapped_pages_queue);
+        if (page != NULL) {
+            if (present_pages_num >= MAX_PRESENT_PFN) {
+                swap_out();
+            }
+            swap_in(page);
+        }
+    }
+    return get_kva_of_uva(uva, pgdir);
+}
+
+// keep the present page holding `kva` in memory, see `page_t.pin`
+void page_pin(uint64_t kva) {
+    page_t *page = find_page_with_kva(ROUNDDOWN(kva, PAGE_SIZE), &present_pages_queue);
+    if (page != NULL) page->pin++;
+}
+
+void page_unpin(uint64_t kva) {
+    page_t *page = find_page_with_kva(ROUNDDOWN(kva, PAGE_SIZE), &present_pages_queue);
+    if (page != NULL && page->pin > 0) page->pin--;
 }
 
 void free_page_with_uva(uint64_t uva, PTE *pgdir) {
@@ -308,6 +366,64 @@ void free_page_with_kva(uint64_t kva) {
     kfree(page->kva);
 }
 
+// whether `uva` maps a page of `pgdir` alone, one in the page queues,
+// which may be detached: a page pinned by a futex waiter is keyed by
+// its kva and must stay where it is, swapped pages are never pinned
+int page_is_movable(uint64_t uva, PTE *pgdir) {
+    page_t *page = find_page_with_uva(uva, pgdir, &present_pages_queue);
+    if (page != NULL) return page->pin == 0;
+
+    return find_page_with_uva(uva, pgdir, &swapped_pages_queue) != NULL;
+}
+
+// unmap the private page at `uva` from `pgdir` and take it out of the
+// page queues, swapping it in first if it is out. the page keeps its
+// entry of `pages` and its memory, no one can swap or free it until it
+// is attached somewhere again or dropped
+page_t *page_detach(uint64_t uva, PTE *pgdir) {
+    page_t *page = find_page_with_uva(uva, pgdir, &present_pages_queue);
+
+    if (page == NULL) {
+        page = find_page_with_uva(uva, pgdir, &swapped_pages_queue);
+        if (page == NULL) return NULL;
+
+        if (present_pages_num >= MAX_PRESENT_PFN) {
+            swap_out();
+        }
+        swap_in(page);
+    }
+
+    assert(page->pin == 0);
+
+    PTE *pte = get_pte_of_uva(uva, pgdir);
+    *pte = 0;
+    mm_flush_page(pgdir, uva);
+
+    list_delete_entry(&page->list);
+    present_pages_num--;
+    page->uva = 0, page->pgdir = NULL;
+    return page;
+}
+
+// map a detached page at `uva` of `pgdir`, the bytes stay where they are
+void page_attach(page_t *page, uint64_t uva, PTE *pgdir) {
+    map_uva_to_kva(uva, page->kva, pgdir);
+
+    if (present_pages_num >= MAX_PRESENT_PFN) {
+        swap_out();
+    }
+    page->uva = uva, page->pgdir = pgdir;
+    list_add_tail(&page->list, &present_pages_queue);
+    present_pages_num++;
+}
+
+// free a detached page
+void page_drop(page_t *page) {
+    assert(page->pin == 0);
+    kfree(page->kva);
+    reset_page_info(page);
+}
+
 share_page_t share_pages[MAX_SHARE_PAGE_NUM];
 
 uintptr_t shm_page_get(int key)
@@ -358,6 +474,7 @@ void shm_page_dt(uintptr_t addr)
     // unmap addr in current_running->pgdir
     PTE *pte = get_pte_of_uva(addr, pgdir);
     *pte = 0;
+    mm_flush_page(pgdir, addr);
 
     for (int i = 0; i < MAX_SHARE_PAGE_NUM; i++) {
         if (share_pages[i].kva == kva) {
@@ -0,0 +1,54 @@
+#include <os/mm.h>
+#include <assert.h>
+
+// slab allocator for small kernel objects of one size: pages from
+// kalloc are cut into objects, free objects are linked through their
+// first word. pages are kept by the cache once allocated.
+
+void slab_cache_init(slab_cache_t *cache, uint32_t size)
+{
+    // objects are 8-byte aligned and large enough to hold the link
+    size = ROUND(size, sizeof(void *));
+    assert(size <= PAGE_SIZE);
+
+    cache->size    = size;
+    cache->free    = NULL;
+    cache->nr_used = 0;
+    cache->nr_free = 0;
+}
+
+static void slab_grow(slab_cache_t *cache)
+{
+    uint64_t page = (uint64_t)kalloc();
+    int nr_objs = PAGE_SIZE / cache->size;
+
+    for (int i = nr_objs - 1; i >= 0; i--) {
+        slab_obj_t *obj = (slab_obj_t *)(page + i * cache->size);
+        obj->next   = cache->free;
+        cache->free = obj;
+    }
+    cache->nr_free += nr_objs;
+}
+
+// the object is not cleared
+void *slab_alloc(slab_cache_t *cache)
+{
+    if (cache->free == NULL) {
+        slab_grow(cache);
+    }
+
+    slab_obj_t *obj = cache->free;
+    cache->free = obj->next;
+    cache->nr_free--;
+    cache->nr_used++;
+    return obj;
+}
+
+void slab_free(slab_cache_t *cache, void *ptr)
+{
+    slab_obj_t *obj = (slab_obj_t *)ptr;
+    obj->next   = cache->free;
+    cache->free = obj;
+    cache->nr_free++;
+    cache->nr_used--;
+}
@@ -5,17 +5,23 @@
 #include <os/string.h>
 #include <os/list.h>
 #include <os/smp.h>
+#include <os/lock.h>
 
 static LIST_HEAD(send_block_queue);
 static LIST_HEAD(recv_block_queue);
 
+// protects the e1000 descriptor rings and the queues above
+spin_lock_t net_lock;
+
 int do_net_send(void *txpacket, int length)
 {
     // Transmit one network packet via e1000 device
     // Call do_block when e1000 transmit queue is full
+    spin_lock_acquire(&net_lock);
     while (e1000_transmit(txpacket, length) == 0) {
-        do_block(&current_running->list, &send_block_queue);
+        do_block(&current_running->list, &send_block_queue, &net_lock);
     }
+    spin_lock_release(&net_lock);
 
     return length;  // Bytes it has transmitted
 }
@@ -26,9 +32,10 @@ int do_net_recv(void *rxbuffer, int pkt_num, int *pkt_lens)
     // Call do_block when there is no packet on the way
 
     int bytes = 0, len = 0;
+    spin_lock_acquire(&net_lock);
     for (int i = 0; i < pkt_num; i++) {
         while ((len = e1000_poll(rxbuffer)) == 0) {
-            do_block(&current_running->list, &recv_block_queue);
+            do_block(&current_running->list, &recv_block_queue, &net_lock);
         }
 
         *pkt_lens = len;
@@ -37,25 +44,41 @@ int do_net_recv(void *rxbuffer, int pkt_num, int *pkt_lens)
 
         rxbuffer = (void *)((uint64_t)rxbuffer + len);
     }
+    spin_lock_release(&net_lock);
 
 
     return bytes;  // Bytes it has received
 }
 
+// blocked net tasks are only woken up by polling in do_scheduler,
+// read without net_lock: a stale answer only changes the next tick
+int net_has_waiters(void) {
+    return !is_queue_empty(&send_block_queue) || !is_queue_empty(&recv_block_queue);
+}
+
+// called without sched_lock, which do_unblock takes under net_lock
 void check_net_send() {
+    if (is_queue_empty(&send_block_queue)) return;
+
+    spin_lock_acquire(&net_lock);
     if (is_tx_desc_stat_dd()) {
         pcb_t *p, *p_q;
         list_for_each_entry_safe(p, p_q, &send_block_queue) {
             do_unblock(&p->list);
         }
     }
+    spin_lock_release(&net_lock);
 }
 
 void check_net_recv() {
+    if (is_queue_empty(&recv_block_queue)) return;
+
+    spin_lock_acquire(&net_lock);
     if (is_rx_desc_stat_dd()) {
         pcb_t *p, *p_q;
         list_for_each_entry_safe(p, p_q, &recv_block_queue) {
             do_unblock(&p->list);
         }
     }
+    spin_lock_release(&net_lock);
 }
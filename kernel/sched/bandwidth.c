@@ -0,0 +1,155 @@
+#include <os/sched.h>
+#include <os/time.h>
+#include <os/list.h>
+#include <os/smp.h>
+
+// cpu bandwidth control: the tasks of a group share `quota` ticks of
+// runtime every `period` ticks. update_curr charges the running task to
+// its group, and when the runtime is used up the timer tick throttles
+// the whole group: its ready tasks are parked on the throttled list of
+// the group instead of a run queue, and its running tasks leave their
+// cpus. the refill timer gives the group its quota back every period
+// and puts the parked tasks back to their run queues.
+
+static bw_group_t bw_groups[NUM_BW_GROUPS];
+
+static void bw_refill(void *arg);
+
+void init_bw_groups(void)
+{
+    for (int i = 0; i < NUM_BW_GROUPS; i++) {
+        bw_group_t *g = &bw_groups[i];
+        g->quota = 0;
+        g->throttled = 0;
+        INIT_LIST_HEAD(&g->throttled_list);
+        timer_init(&g->refill_timer, bw_refill, g);
+    }
+}
+
+static inline bw_group_t *find_bw_group(int gid)
+{
+    return gid >= 1 && gid <= NUM_BW_GROUPS ? &bw_groups[gid - 1] : NULL;
+}
+
+static void throttle_group(bw_group_t *g)
+{
+    int cpuid = get_current_cpu_id();
+
+    g->throttled = 1;
+    g->nr_throttled++;
+
+    list_node_t *node;
+    for (node = task_list.next; node != &task_list; node = node->next) {
+        pcb_t *p = list_entry_of(node, pcb_t, task_node);
+        if (p->bw_group != g || !task_bw_limited(p)) continue;
+
+        // requeueing a ready task parks it
+        if (p->status == TASK_READY && !p->bw_throttled) {
+            dequeue_task(p);
+            enqueue_task(p, p->cpu);
+        } else if (p->status == TASK_RUNNING && p->cpu != cpuid && runnings[p->cpu] == p) {
+            send_resched_ipi(p->cpu);
+        }
+    }
+}
+
+static void unthrottle_group(bw_group_t *g)
+{
+    g->throttled = 0;
+
+    while (!is_queue_empty(&g->throttled_list)) {
+        pcb_t *p = list_entry(g->throttled_list.next, pcb_t);
+        dequeue_task(p);
+        enqueue_task(p, p->cpu);
+        wake_up_idle_cpu(p);
+    }
+}
+
+// the running task used its share: throttle its group once the
+// runtime of the group is gone, return 1 if curr has to leave the cpu
+int bw_check_throttle(pcb_t *curr)
+{
+    if (!task_bw_limited(curr)) return 0;
+
+    bw_group_t *g = curr->bw_group;
+    if (!g->throttled && g->runtime <= 0) {
+        throttle_group(g);
+    }
+    return g->throttled;
+}
+
+// start of a period: an overrun of the last period is paid back first
+static void bw_refill(void *arg)
+{
+    bw_group_t *g = (bw_group_t *)arg;
+    uint64_t now = get_ticks();
+
+    g->runtime += g->quota;
+    if (g->runtime > (int64_t)g->quota) g->runtime = g->quota;
+
+    if (g->throttled && g->runtime > 0) {
+        unthrottle_group(g);
+    }
+
+    // periods missed while the timer was late are skipped
+    uint64_t next = g->refill_timer.node.key + g->period;
+    if (next <= now) next = now + g->period;
+    timer_add(&g->refill_timer, next);
+}
+
+// set the quota of group `gid`, times in microseconds. quota 0 lifts
+// the limit, the tasks stay in the group. return 1 for success, 0 for
+// a bad group id or a quota larger than the period
+int do_cpu_quota(int gid, uint64_t quota_us, uint64_t period_us)
+{
+    bw_group_t *g = find_bw_group(gid);
+    if (g == NULL) return 0;
+
+    uint64_t quota  = us_to_ticks(quota_us);
+    uint64_t period = us_to_ticks(period_us);
+    if (quota_us != 0 && (quota == 0 || quota > period)) return 0;
+
+    timer_del(&g->refill_timer);
+    if (g->throttled) unthrottle_group(g);
+
+    g->quota  = quota;
+    g->period = period;
+    g->runtime = quota;
+    if (quota != 0) {
+        timer_add(&g->refill_timer, get_ticks() + period);
+    }
+    return 1;
+}
+
+// move all threads of process `pid` (0 for the caller) into group
+// `gid`, gid 0 takes them out of their group. return 1 for success, 0
+// for a bad group id, a group without quota, or no such process
+int do_cpu_group(int gid, pid_t pid)
+{
+    bw_group_t *g = NULL;
+    if (gid != 0) {
+        g = find_bw_group(gid);
+        if (g == NULL || g->quota == 0) return 0;
+    }
+    if (pid == 0) pid = current_running->pid;
+
+    int found = 0;
+    list_node_t *node;
+    for (node = task_list.next; node != &task_list; node = node->next) {
+        pcb_t *p = list_entry_of(node, pcb_t, task_node);
+        if (p->pid != pid) continue;
+
+        // a ready task is requeued under the state of its new group
+        int queued = p->status == TASK_READY;
+        if (queued) dequeue_task(p);
+        p->bw_group = g;
+        if (queued) {
+            enqueue_task(p, p->cpu);
+            wake_up_idle_cpu(p);
+        }
+        found = 1;
+    }
+
+    // a running thread of a throttled group leaves its cpu on the next tick
+    return found;
+}
@@ -0,0 +1,225 @@
+#include <os/sched.h>
+#include <os/time.h>
+#include <os/heap.h>
+#include <os/list.h>
+#include <os/trace.h>
+#include <assert.h>
+
+// earliest deadline first for tasks that reserve `runtime` ticks every
+// `period` ticks, each job has to finish `deadline` ticks after its
+// period starts. a job ends when the task yields, a task that uses up
+// its budget is throttled until the next period, so deadline tasks
+// never take more than their admitted bandwidth from best-effort ones.
+// deadline tasks are partitioned: a task only runs on the cpu that
+// admitted it, which is one of its cpu_mask
+
+static void enqueue_task_dl(run_queue_t *rq, pcb_t *p)
+{
+    if (p->dl_throttled) {
+        list_add_tail(&p->list, &rq->dl_throttled);
+    } else {
+        // the list node is not used while queued, keep it harmless to delete
+        INIT_LIST_HEAD(&p->list);
+
+        p->run_node.key = p->dl_abs_deadline;
+        assert(heap_push(&rq->dl_heap, &p->run_node));
+        rq->nr_dl++;
+    }
+}
+
+static void dequeue_task_dl(run_queue_t *rq, pcb_t *p)
+{
+    if (heap_node_queued(&p->run_node)) {
+        heap_remove(&rq->dl_heap, &p->run_node);
+        rq->nr_dl--;
+    } else {
+        list_delete_init(&p->list);
+    }
+}
+
+static pcb_t *pick_next_task_dl(run_queue_t *rq)
+{
+    heap_node_t *first = heap_peek(&rq->dl_heap);
+    return first == NULL ? NULL : heap_entry(first, pcb_t, run_node);
+}
+
+static void update_curr_dl(run_queue_t *rq, pcb_t *curr, uint64_t delta)
+{
+    curr->dl_budget = delta < curr->dl_budget ? curr->dl_budget - delta : 0;
+}
+
+static int task_tick_dl(run_queue_t *rq, pcb_t *curr)
+{
+    if (curr->dl_budget == 0) {
+        curr->dl_throttled = 1;
+        return 1;
+    }
+
+    // a job with an earlier deadline is ready
+    heap_node_t *first = heap_peek(&rq->dl_heap);
+    return first != NULL && first->key < curr->dl_abs_deadline;
+}
+
+// yielding finishes the current job
+static void yield_task_dl(run_queue_t *rq, pcb_t *curr)
+{
+    if (get_ticks() > curr->dl_abs_deadline) {
+        curr->dl_misses++;
+    }
+    curr->dl_done = 1;
+    curr->dl_throttled = 1;
+}
+
+// start of a new period: release the next job with a full budget
+static void dl_replenish(void *arg)
+{
+    pcb_t *p = (pcb_t *)arg;
+    uint64_t now = get_ticks();
+
+    trace_event(TRACE_TIMER, p, 0);
+
+    // the job of the last period is still runnable, or it blocked
+    // halfway and did not finish before the period was over
+    int runnable = p->status == TASK_READY || p->status == TASK_RUNNING;
+    if (!p->dl_done && (runnable || p->dl_budget < p->dl_runtime)) {
+        p->dl_misses++;
+    }
+
+    // requeued unthrottled, which counts it as ready again
+    int queued = p->status == TASK_READY;
+    if (queued) dequeue_task(p);
+
+    // periods missed while the timer was late are skipped
+    uint64_t release = p->dl_abs_deadline - p->dl_deadline + p->dl_period;
+    while (release + p->dl_period <= now) {
+        release += p->dl_period;
+    }
+
+    p->dl_abs_deadline = release + p->dl_deadline;
+    p->dl_budget       = p->dl_runtime;
+    p->dl_throttled    = 0;
+    p->dl_done         = 0;
+
+    if (queued) {
+        trace_event(TRACE_UNBLOCK, p, 0);
+        enqueue_task(p, p->dl_cpu);
+        wake_up_idle_cpu(p);
+    }
+    timer_add(&p->dl_timer, release + p->dl_period);
+}
+
+// the constant bandwidth server wakeup rule: a task which wakes up past
+// its deadline, or with more budget left than its bandwidth covers until
+// then, would jump ahead of the other jobs with a stale deadline or take
+// more than it reserved. it starts a new job with a full budget and a
+// deadline from now instead, and its next period starts now
+void dl_task_woken(pcb_t *p)
+{
+    uint64_t now = get_ticks();
+
+    // a throttled task waits for its next period anyway
+    if (p->dl_throttled) return;
+    if (now < p->dl_abs_deadline &&
+        (p->dl_budget << DL_BW_SHIFT) <= p->dl_bw * (p->dl_abs_deadline - now)) {
+        return;
+    }
+
+    // the job it blocked in is over its deadline
+    if (!p->dl_done && p->dl_budget < p->dl_runtime && now > p->dl_abs_deadline) {
+        p->dl_misses++;
+    }
+
+    p->dl_abs_deadline = now + p->dl_deadline;
+    p->dl_budget       = p->dl_runtime;
+    p->dl_done         = 0;
+    timer_add(&p->dl_timer, now + p->dl_period);
+}
+
+void init_dl_entity(pcb_t *p)
+{
+    p->dl_runtime   = 0;
+    p->dl_throttled = 0;
+    p->dl_misses    = 0;
+    timer_init(&p->dl_timer, dl_replenish, p);
+}
+
+// give back the bandwidth of a deadline task, it must not be queued
+void exit_dl_entity(pcb_t *p)
+{
+    if (!is_dl_task(p)) return;
+
+    run_queues[p->dl_cpu].dl_bw -= p->dl_bw;
+    timer_del(&p->dl_timer);
+    p->dl_runtime   = 0;
+    p->dl_throttled = 0;
+}
+
+// make process `pid` (0 for the caller) a deadline task, times are in
+// microseconds and runtime 0 makes it a normal task again. the
+// parameters are per task: a pid reaches the main thread of the
+// process only, the caller (pid 0) may be any of its threads
+// return 1 for success, 0 for no such process, invalid parameters or
+// overload, -1 for a time which is shorter than a tick
+int do_sched_deadline(pid_t pid, uint64_t runtime_us, uint64_t deadline_us, uint64_t period_us)
+{
+    pcb_t *p = pid == 0 ? current_running : find_task(pid);
+    if (p == NULL) return 0;
+
+    uint64_t runtime  = us_to_ticks(runtime_us);
+    uint64_t deadline = us_to_ticks(deadline_us);
+    uint64_t period   = us_to_ticks(period_us);
+
+    // rounded down to 0 it would ask for a normal task instead
+    if (runtime_us != 0 && (runtime == 0 || deadline == 0 || period == 0)) return -1;
+    if (runtime != 0 && (runtime > deadline || deadline > period)) return 0;
+
+    // admission control: the first cpu which still has room for the bandwidth
+    uint64_t bw = runtime == 0 ? 0 : (runtime << DL_BW_SHIFT) / period;
+    int cpu = -1;
+    for (int i = 0; runtime != 0 && i < nr_cpus; i++) {
+        int c = (p->cpu + i) % nr_cpus;
+        if (!cpu_allowed(p, c)) continue;
+
+        uint64_t used = run_queues[c].dl_bw;
+        if (is_dl_task(p) && p->dl_cpu == c) used -= p->dl_bw;
+
+        if (used + bw <= DL_BW_LIMIT) {
+            cpu = c;
+            break;
+        }
+    }
+    if (runtime != 0 && cpu < 0) return 0;
+
+    int queued = p->status == TASK_READY;
+    if (queued) dequeue_task(p);
+    exit_dl_entity(p);
+
+    if (runtime != 0) {
+        uint64_t now = get_ticks();
+
+        p->dl_runtime  = runtime;
+        p->dl_deadline = deadline;
+        p->dl_period   = period;
+        p->dl_bw       = bw;
+        p->dl_cpu      = cpu;
+        run_queues[cpu].dl_bw += bw;
+
+        p->dl_abs_deadline = now + deadline;
+        p->dl_budget       = runtime;
+        p->dl_done         = 0;
+        p->dl_misses       = 0;
+        timer_add(&p->dl_timer, now + period);
+    }
+
+    if (queued) enqueue_task(p, p->cpu);
+    return 1;
+}
+
+const sched_class_t dl_sched_class = {
+    .enqueue_task   = enqueue_task_dl,
+    .dequeue_task   = dequeue_task_dl,
+    .pick_next_task = pick_next_task_dl,
+    .update_curr    = update_curr_dl,
+    .task_tick      = task_tick_dl,
+    .yield_task     = yield_task_dl,
+};
@@ -0,0 +1,125 @@
+#include <os/sched.h>
+#include <os/heap.h>
+#include <os/list.h>
+#include <assert.h>
+
+// fair scheduling: ready tasks are kept in a min-heap keyed by vruntime,
+// the cpu time a task has consumed scaled down by its weight.
+// the task with the smallest vruntime is the one that got least of its share
+
+// load weight of nice -20 .. 19, each step is about 10% of cpu time
+static const uint32_t prio_to_weight[40] = {
+ /* -20 */     88761,     71755,     56483,     46273,     36291,
+ /* -15 */     29154,     23254,     18705,     14949,     11916,
+ /* -10 */      9548,      7620,      6100,      4904,      3906,
+ /*  -5 */      3121,      2501,      1991,      1586,      1277,
+ /*   0 */      1024,       820,       655,       526,       423,
+ /*   5 */       335,       272,       215,       172,       137,
+ /*  10 */       110,        87,        70,        56,        45,
+ /*  15 */        36,        29,        23,        18,        15,
+};
+
+uint32_t nice_to_weight(int nice)
+{
+    return prio_to_weight[nice - NICE_MIN];
+}
+
+// min_vruntime only moves forward, it follows the smallest vruntime
+// of the running task and the ready ones
+static void update_min_vruntime(run_queue_t *rq, pcb_t *curr)
+{
+    uint64_t vruntime = curr->vruntime;
+    heap_node_t *first = heap_peek(&rq->fair_heap);
+
+    if (first != NULL && first->key < vruntime) {
+        vruntime = first->key;
+    }
+    if (vruntime > rq->min_vruntime) {
+        rq->min_vruntime = vruntime;
+    }
+}
+
+static void enqueue_task_fair(run_queue_t *rq, pcb_t *p)
+{
+    // a new task, or one that slept for long, only gets half a latency
+    // of credit instead of running until it catches up with the others
+    uint64_t floor = 0;
+    if (rq->min_vruntime > SCHED_LATENCY / 2) {
+        floor = rq->min_vruntime - SCHED_LATENCY / 2;
+    }
+    if (p->vruntime < floor) {
+        p->vruntime = floor;
+    }
+
+    // the list node is not used while queued, keep it harmless to delete
+    INIT_LIST_HEAD(&p->list);
+
+    p->run_node.key = p->vruntime;
+    assert(heap_push(&rq->fair_heap, &p->run_node));
+    rq->load += p->weight;
+}
+
+static void dequeue_task_fair(run_queue_t *rq, pcb_t *p)
+{
+    heap_remove(&rq->fair_heap, &p->run_node);
+    rq->load -= p->weight;
+}
+
+static pcb_t *pick_next_task_fair(run_queue_t *rq)
+{
+    heap_node_t *first = heap_peek(&rq->fair_heap);
+    return first == NULL ? NULL : heap_entry(first, pcb_t, run_node);
+}
+
+static void update_curr_fair(run_queue_t *rq, pcb_t *curr, uint64_t delta)
+{
+    curr->vruntime += delta * NICE_0_WEIGHT / curr->weight;
+    update_min_vruntime(rq, curr);
+}
+
+static int task_tick_fair(run_queue_t *rq, pcb_t *curr)
+{
+    heap_node_t *first = heap_peek(&rq->fair_heap);
+    if (first == NULL) return 0;
+
+    // curr used up its share of the scheduling period
+    uint64_t slice = SCHED_LATENCY * curr->weight / (rq->load + curr->weight);
+    if (slice < SCHED_MIN_GRANULARITY) {
+        slice = SCHED_MIN_GRANULARITY;
+    }
+    if (curr->sum_exec_runtime - curr->slice_start >= slice) return 1;
+
+    // a woken up task is far behind curr
+    return curr->vruntime > first->key + SCHED_WAKEUP_GRANULARITY;
+}
+
+// a yielding task goes behind the leftmost ready task
+static void yield_task_fair(run_queue_t *rq, pcb_t *curr)
+{
+    heap_node_t *first = heap_peek(&rq->fair_heap);
+    if (first != NULL && curr->vruntime <= first->key) {
+        curr->vruntime = first->key + 1;
+    }
+}
+
+// vruntime is relative to the min_vruntime of the queue it was accrued in
+static void migrate_task_fair(run_queue_t *src, run_queue_t *dst, pcb_t *p)
+{
+    int64_t lag = (int64_t)(p->vruntime - src->min_vruntime);
+
+    if (lag < 0 && (uint64_t)(-lag) > dst->min_vruntime) {
+        p->vruntime = 0;
+    } else {
+        p->vruntime = dst->min_vruntime + lag;
+    }
+}
+
+const sched_class_t fair_sched_class = {
+    .enqueue_task   = enqueue_task_fair,
+    .dequeue_task   = dequeue_task_fair,
+    .pick_next_task = pick_next_task_fair,
+    .update_curr    = update_curr_fair,
+    .task_tick      = task_tick_fair,
+    .yield_task     = yield_task_fair,
+    .migrate_task   = migrate_task_fair,
+};
@@ -0,0 +1,102 @@
+#include <os/sched.h>
+#include <os/time.h>
+#include <os/list.h>
+
+// multi-level feedback queue: a task that burns its whole slice is
+// demoted to a lower level with a longer slice, a task that blocks
+// before its slice ends keeps its level. tasks of a higher level always
+// run first, and a periodic boost keeps the low levels from starving.
+// the slice is an allotment of cpu time at the level, which only a
+// demotion, a boost or a block starts over: a task that yields or is
+// preempted just before the end of its slice does not stay on top
+
+static inline uint64_t mlfq_slice(int level)
+{
+    return (uint64_t)TIMER_INTERVAL << level;
+}
+
+// highest level with a ready task, MLFQ_LEVELS if there is none
+static int highest_ready_level(run_queue_t *rq)
+{
+    int level = 0;
+    while (level < MLFQ_LEVELS && is_queue_empty(&rq->mlfq_queues[level])) {
+        level++;
+    }
+    return level;
+}
+
+static void boost(run_queue_t *rq, pcb_t *curr)
+{
+    list_head *top = &rq->mlfq_queues[0];
+
+    for (int level = 1; level < MLFQ_LEVELS; level++) {
+        list_head *queue = &rq->mlfq_queues[level];
+        while (!is_queue_empty(queue)) {
+            pcb_t *p = list_entry(queue->next, pcb_t);
+            list_delete_entry(&p->list);
+            list_add_tail(&p->list, top);
+            p->mlfq_level = 0;
+            p->mlfq_used  = 0;
+        }
+    }
+
+    curr->mlfq_level = 0;
+    curr->mlfq_used  = 0;
+    rq->last_boost = get_ticks();
+}
+
+static void enqueue_task_mlfq(run_queue_t *rq, pcb_t *p)
+{
+    list_add_tail(&p->list, &rq->mlfq_queues[p->mlfq_level]);
+}
+
+static void dequeue_task_mlfq(run_queue_t *rq, pcb_t *p)
+{
+    list_delete_init(&p->list);
+}
+
+static pcb_t *pick_next_task_mlfq(run_queue_t *rq)
+{
+    int level = highest_ready_level(rq);
+    if (level == MLFQ_LEVELS) return NULL;
+    return list_entry(rq->mlfq_queues[level].next, pcb_t);
+}
+
+static void update_curr_mlfq(run_queue_t *rq, pcb_t *curr, uint64_t delta)
+{
+    curr->mlfq_used += delta;
+}
+
+static int task_tick_mlfq(run_queue_t *rq, pcb_t *curr)
+{
+    if (get_ticks() - rq->last_boost >= MLFQ_BOOST_INTERVAL) {
+        boost(rq, curr);
+    }
+
+    // the whole slice is used up: demote curr and start a new slice
+    if (curr->mlfq_used >= mlfq_slice(curr->mlfq_level)) {
+        if (curr->mlfq_level < MLFQ_LEVELS - 1) {
+            curr->mlfq_level++;
+        }
+        curr->mlfq_used = 0;
+        return highest_ready_level(rq) <= curr->mlfq_level;
+    }
+
+    // a task of a higher level is ready
+    return highest_ready_level(rq) < curr->mlfq_level;
+}
+
+// blocking before the slice is over keeps the level with a new slice
+static void block_task_mlfq(run_queue_t *rq, pcb_t *curr)
+{
+    curr->mlfq_used = 0;
+}
+
+const sched_class_t mlfq_sched_class = {
+    .enqueue_task   = enqueue_task_mlfq,
+    .dequeue_task   = dequeue_task_mlfq,
+    .pick_next_task = pick_next_task_mlfq,
+    .update_curr    = update_curr_mlfq,
+    .task_tick      = task_tick_mlfq,
+    .block_task     = block_task_mlfq,
+};
@@ -0,0 +1,37 @@
+#include <os/sched.h>
+#include <os/list.h>
+
+// round robin: every tick moves the running task to the tail of the queue
+
+static void enqueue_task_rr(run_queue_t *rq, pcb_t *p)
+{
+    list_add_tail(&p->list, &rq->ready_queue);
+}
+
+static void dequeue_task_rr(run_queue_t *rq, pcb_t *p)
+{
+    list_delete_init(&p->list);
+}
+
+static pcb_t *pick_next_task_rr(run_queue_t *rq)
+{
+    if (is_queue_empty(&rq->ready_queue)) return NULL;
+    return list_entry(rq->ready_queue.next, pcb_t);
+}
+
+static void update_curr_rr(run_queue_t *rq, pcb_t *curr, uint64_t delta)
+{
+}
+
+static int task_tick_rr(run_queue_t *rq, pcb_t *curr)
+{
+    return !is_queue_empty(&rq->ready_queue);
+}
+
+const sched_class_t rr_sched_class = {
+    .enqueue_task   = enqueue_task_rr,
+    .dequeue_task   = dequeue_task_rr,
+    .pick_next_task = pick_next_task_rr,
+    .update_curr    = update_curr_rr,
+    .task_tick      = task_tick_rr,
+};
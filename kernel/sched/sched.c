@@ -8,7 +8,9 @@
 #include <os/smp.h>
 #include <os/string.h>
 #include <os/net.h>
+#include <os/trace.h>
 #include <pgtable.h>
+#include <common.h>
 #include <csr.h>
 #include <screen.h>
 #include <printk.h>
@@ -18,94 +20,443 @@
 
 extern void ret_from_exception();
 
-pcb_t pcb[NUM_MAX_TASK];
-int threads[NUM_MAX_SUB_THREADS];
+// pcbs are allocated from a slab, live ones are linked in `task_list`
+// and hashed by pid and by (pid, tid). an exited pcb is freed once its
+// cpu has switched away from it, see `reap_zombies`
+static slab_cache_t pcb_cache;
+LIST_HEAD(task_list);
+static LIST_HEAD(zombie_list);
+static list_head pid_hash[PID_HASH_SIZE];
+static list_head tid_hash[PID_HASH_SIZE];
 
-int tcb_id = 0;
+// live pcbs and their runtime limits
+static int nr_tasks;
+int max_tasks   = DEFAULT_MAX_TASKS;
+int max_threads = DEFAULT_MAX_THREADS;
 
-pcb_t pid0_pcb  = { .pid = 0, .pgdir = (PTE *)PGDIR_VA };
-pcb_t pid0_pcb2 = { .pid = 0, .pgdir = (PTE *)PGDIR_VA };
+int tcb_id = 0;
 
-extern mutex_lock_t mlocks[LOCK_NUM];
+pcb_t pid0_pcbs[NR_CPUS];
 
 const char *status[] = {"BLOCKED", "RUNNING", "READY", "EXITED"};
 
-LIST_HEAD(ready_queue);
+// per-cpu run queues, initialized by `init_run_queues`
+run_queue_t run_queues[NR_CPUS];
+
+static const sched_class_t *const policy_classes[] = {
+    [SCHED_RR]   = &rr_sched_class,
+    [SCHED_FAIR] = &fair_sched_class,
+    [SCHED_MLFQ] = &mlfq_sched_class,
+};
+
+// policy of all normal tasks, see do_sched_policy
+#if SCHED_POLICY == SCHED_RR
+static const sched_class_t *sched_class = &rr_sched_class;
+#elif SCHED_POLICY == SCHED_MLFQ
+static const sched_class_t *sched_class = &mlfq_sched_class;
+#else
+static const sched_class_t *sched_class = &fair_sched_class;
+#endif
 LIST_HEAD(sleep_queue);
 
 // current running pcbs(for multicores)
 pcb_t *volatile runnings[NR_CPUS];
 
-/* current running task PCB */
-pcb_t * volatile current_running;
+// run queues, pcbs and their hashes, timers, and the sleep and wait
+// queues. it is held across `switch_to`: the task switched to releases
+// it, in `ret_from_fork` if it has never run before
+spin_lock_t sched_lock;
 
 /* global process id */
 pid_t process_id = 1;
 
+// time at which the timer of each cpu is going to fire
+static uint64_t timer_armed[NR_CPUS];
+
+// a task woken up on this cpu preempts the running one, which is
+// switched away from on the way out of the kernel
+static volatile int need_resched[NR_CPUS];
+
+static void update_curr(void);
+static void schedule(void);
+
 
-// switch to the pagetable of user process
-// then flush TLB
+// switch to the pagetable of user process,
+// the TLB is only flushed when ASIDs run out or mappings changed
 void switch_pgdir() {
-    set_satp(SATP_MODE_SV39, current_running->pid,
-             kva2pa((uintptr_t)current_running->pgdir) >> NORMAL_PAGE_SHIFT);
-    local_flush_tlb_all();
+    switch_mm(current_running->pgdir);
 }
 
 void ret_from_kernel() {
-    asm volatile ("ld tp, %0": :"m"(current_running));
+    // killed by another cpu while it ran in the kernel on this one
+    if (current_running->killed) do_exit();
+
+    int cpuid = get_current_cpu_id();
+    if (need_resched[cpuid]) {
+        spin_lock_acquire(&sched_lock);
+        need_resched[cpuid] = 0;
+        update_curr();
+        schedule();
+        spin_lock_release(&sched_lock);
+    }
+
+    asm volatile ("mv tp, %0": :"r"(current_running));
     
+    update_timer();
     switch_pgdir();
-    unlock_kernel();
+    account_kernel_time();
     ret_from_exception();
 }
 
+// a new task starts here, in the middle of a `switch_to` to it
+void ret_from_fork() {
+    spin_lock_release(&sched_lock);
+    ret_from_kernel();
+}
+
+static inline int is_idle_task(pcb_t *p) {
+    return p >= &pid0_pcbs[0] && p < &pid0_pcbs[NR_CPUS];
+}
+
+static inline const sched_class_t *task_sched_class(pcb_t *p) {
+    return is_dl_task(p) ? &dl_sched_class : sched_class;
+}
+
+void init_run_queues(void) {
+    for (int i = 0; i < NR_CPUS; i++) {
+        run_queue_t *rq = &run_queues[i];
+
+        rq->nr_ready = 0;
+        INIT_LIST_HEAD(&rq->ready_queue);
+        heap_init(&rq->fair_heap);
+        rq->min_vruntime = 0;
+        rq->load = 0;
+        for (int j = 0; j < MLFQ_LEVELS; j++) {
+            INIT_LIST_HEAD(&rq->mlfq_queues[j]);
+        }
+        rq->last_boost = 0;
+        heap_init(&rq->dl_heap);
+        INIT_LIST_HEAD(&rq->dl_throttled);
+        rq->nr_dl = 0;
+        rq->dl_bw = 0;
+    }
+}
+
+// an allowed cpu for `p`: `cpu` itself, or else the cpu it ran on
+// last (its cache is still warm), or else the least loaded one
+static int select_task_cpu(pcb_t *p, int cpu) {
+    if (cpu_allowed(p, cpu)) return cpu;
+    if (cpu_allowed(p, p->cpu)) return p->cpu;
+
+    int best = -1;
+    for (int i = 0; i < NR_CPUS; i++) {
+        if (!cpu_allowed(p, i)) continue;
+        if (best < 0 || run_queues[i].nr_ready < run_queues[best].nr_ready) {
+            best = i;
+        }
+    }
+    return best;
+}
+
+// put a ready task into the run queue of `cpu`, or of an allowed cpu
+// if its cpu_mask leaves `cpu` out
+void enqueue_task(pcb_t *p, int cpu) {
+    // a deadline task only runs on the cpu which admitted it
+    cpu = is_dl_task(p) ? p->dl_cpu : select_task_cpu(p, cpu);
+    run_queue_t *rq = &run_queues[cpu];
+
+    // a task made ready starts to wait, a moved one keeps waiting
+    if (p->status != TASK_READY) p->wait_start = get_ticks();
+
+    p->status = TASK_READY;
+    p->cpu    = cpu;
+
+    // a task of a throttled group waits for the refill of its group
+    if (task_bw_throttled(p)) {
+        list_add_tail(&p->list, &p->bw_group->throttled_list);
+        p->bw_throttled = 1;
+        return;
+    }
+
+    // a parked deadline task is not counted as ready, it must not keep
+    // the timer ticking or the cpu looking busy until its next period
+    task_sched_class(p)->enqueue_task(rq, p);
+    if (!dl_parked(p)) rq->nr_ready++;
+}
+
+// remove a ready task from the run queue it is waiting in
+void dequeue_task(pcb_t *p) {
+    run_queue_t *rq = &run_queues[p->cpu];
+
+    if (p->bw_throttled) {
+        list_delete_init(&p->list);
+        p->bw_throttled = 0;
+        return;
+    }
+
+    task_sched_class(p)->dequeue_task(rq, p);
+    if (!dl_parked(p)) rq->nr_ready--;
+}
+
+// whether the ready deadline task `p` preempts the task running on
+// its cpu: an idle or best-effort one, or a job with a later deadline
+static int dl_preempts(pcb_t *p) {
+    pcb_t *curr = runnings[p->cpu];
+
+    return is_idle_task(curr) || !is_dl_task(curr) ||
+           p->dl_abs_deadline < curr->dl_abs_deadline;
+}
+
+// a ready deadline task of `rq` preempts the task running on its cpu
+static int dl_preempts_curr(run_queue_t *rq) {
+    pcb_t *first = dl_sched_class.pick_next_task(rq);
+    return first != NULL && dl_preempts(first);
+}
+
+// a task was made runnable: if it waits on the queue of an idle cpu,
+// or on the empty queue of a busy one, or this cpu is busy and an idle
+// one may run it, send that cpu a reschedule IPI instead of letting
+// the task wait for its next tick.
+// a deadline task which preempts the one running on its cpu does so
+// at once, on the way out of the kernel here or by an IPI elsewhere
+void wake_up_idle_cpu(pcb_t *p) {
+    int cpuid = get_current_cpu_id();
+
+    // the queue of a busy cpu was empty when it armed its timer, maybe
+    // TICKLESS_MAX_INTERVAL out. the IPI makes it arm TIMER_INTERVAL on
+    // the way out of the kernel, see `update_timer`
+    int woke_queue = p->cpu != cpuid && run_queues[p->cpu].nr_ready == 1;
+
+    if (is_dl_task(p)) {
+        if (p->status != TASK_READY || p->dl_throttled) return;
+
+        if (p->cpu == cpuid) {
+            if (dl_preempts(p)) need_resched[cpuid] = 1;
+        } else if (dl_preempts(p) || woke_queue) {
+            send_resched_ipi(p->cpu);
+        }
+        return;
+    }
+
+    if (p->cpu != cpuid) {
+        if (is_idle_task(runnings[p->cpu]) || woke_queue) send_resched_ipi(p->cpu);
+        return;
+    }
+    if (is_idle_task(current_running)) return;
+
+    // an idle cpu steals from the busy one as soon as it schedules
+    for (int i = 0; i < NR_CPUS; i++) {
+        if (i != cpuid && cpu_allowed(p, i) && is_idle_task(runnings[i])) {
+            send_resched_ipi(i);
+            return;
+        }
+    }
+}
+
+// move a ready best-effort task to the run queue of `cpu`
+static void move_task(pcb_t *p, int cpu) {
+    run_queue_t *src = &run_queues[p->cpu];
+
+    dequeue_task(p);
+    if (sched_class->migrate_task != NULL) {
+        sched_class->migrate_task(src, &run_queues[cpu], p);
+    }
+    enqueue_task(p, cpu);
+}
+
+// charge the time since the last update to the running task
+static void update_curr(void) {
+    pcb_t *curr = current_running;
+    uint64_t now = get_ticks();
+    uint64_t delta = now - curr->exec_start;
+
+    curr->exec_start = now;
+    if (is_idle_task(curr)) return;
+
+    curr->sum_exec_runtime += delta;
+    if (task_bw_limited(curr)) {
+        curr->bw_group->runtime -= delta;
+    }
+    task_sched_class(curr)->update_curr(&run_queues[get_current_cpu_id()], curr, delta);
+}
+
+int nr_ready_tasks(void) {
+    int nr = 0;
+    for (int i = 0; i < NR_CPUS; i++) {
+        nr += run_queues[i].nr_ready;
+    }
+    return nr;
+}
+
+// best-effort tasks of a run queue, deadline tasks are never stolen
+static inline int nr_movable(run_queue_t *rq) {
+    return rq->nr_ready - rq->nr_dl;
+}
+
+// a best-effort task of the run queue of `src` that may run on `cpu`,
+// the one its policy would run next is preferred
+static pcb_t *pick_movable_task(int src, int cpu) {
+    pcb_t *p = sched_class->pick_next_task(&run_queues[src]);
+    if (p != NULL && cpu_allowed(p, cpu)) return p;
+
+    list_node_t *node;
+    for (node = task_list.next; node != &task_list; node = node->next) {
+        p = list_entry_of(node, pcb_t, task_node);
+        if (p->status == TASK_READY && p->cpu == src && !p->bw_throttled &&
+            !is_dl_task(p) && cpu_allowed(p, cpu)) {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+// pull one task from the busiest peer into the run queue of `cpuid`
+// an empty queue steals whatever it finds, a non-empty queue only
+// steals when the peer holds at least 2 tasks more than itself
+static void balance_run_queue(int cpuid) {
+    run_queue_t *rq = &run_queues[cpuid];
+    int busiest = -1;
+
+    for (int i = 0; i < NR_CPUS; i++) {
+        if (i == cpuid || nr_movable(&run_queues[i]) == 0) continue;
+        if (busiest < 0 || nr_movable(&run_queues[i]) > nr_movable(&run_queues[busiest])) {
+            busiest = i;
+        }
+    }
+
+    if (busiest < 0) return;
+    if (nr_movable(rq) != 0 && nr_movable(&run_queues[busiest]) < nr_movable(rq) + 2) return;
+
+    // tasks pinned to the peer are left alone
+    pcb_t *stolen = pick_movable_task(busiest, cpuid);
+    if (stolen != NULL) move_task(stolen, cpuid);
+}
+
+// busy and idle ticks of each cpu, accounted up to `cpu_stamp`
+static cpu_stat_t cpu_stats[NR_CPUS];
+static uint64_t cpu_stamp[NR_CPUS];
+
+// statistics of a switch from current_running to `next` on `cpuid`
+static void account_switch(pcb_t *next, int cpuid) {
+    pcb_t *prev = current_running;
+    uint64_t now = get_ticks();
+
+    trace_event(TRACE_SWITCH_OUT, prev, prev->status);
+    trace_event(TRACE_SWITCH_IN, next, prev->pid);
+
+    if (is_idle_task(prev)) {
+        cpu_stats[cpuid].idle += now - cpu_stamp[cpuid];
+    } else {
+        cpu_stats[cpuid].busy += now - cpu_stamp[cpuid];
+        prev->stime += now - prev->mode_start;
+
+        // a task still ready was preempted (or yielded), the others
+        // blocked or exited of their own accord
+        if (prev != next) {
+            if (prev->status == TASK_READY) prev->nivcsw++;
+            else prev->nvcsw++;
+        }
+        if (prev->status == TASK_READY) prev->wait_start = now;
+    }
+    cpu_stamp[cpuid] = now;
+
+    if (!is_idle_task(next)) {
+        next->wait_time += now - next->wait_start;
+        next->mode_start = now;
+    }
+}
+
+// the running task entered the kernel, it ran in user mode since `mode_start`
+void account_user_time(void) {
+    pcb_t *curr = current_running;
+    uint64_t now = get_ticks();
+
+    curr->utime += now - curr->mode_start;
+    curr->mode_start = now;
+}
+
+// the running task returns to user mode
+void account_kernel_time(void) {
+    pcb_t *curr = current_running;
+    uint64_t now = get_ticks();
+
+    curr->stime += now - curr->mode_start;
+    curr->mode_start = now;
+}
+
+// make `next`, which is not queued, the running task of `cpuid`
+static void set_next_task(pcb_t *next, int cpuid) {
+    account_switch(next, cpuid);
+
+    next->status = TASK_RUNNING;
+    next->exec_start = get_ticks();
+    next->slice_start = next->sum_exec_runtime;
+    runnings[cpuid] = next;
+
+    spin_lock_acquire(&mm_lock);
+    swap_in_all_pages(next->pgdir);
+    spin_lock_release(&mm_lock);
+}
+
 void find_idle_task() {
     int cpuid = get_current_cpu_id();
-    
-    // try to find a idle pcb(task), set current_running to it
-    pcb_t *idle_pcb = cpuid == 0 ? &pid0_pcb : &pid0_pcb2;
-    
-    // ready_queue empty: wait until not empty
-    // this occurs when no task in running on all cpus
-    // then all cpus are traped in this loop
-    if (is_queue_empty(&ready_queue)) {
-        goto finish;
+    run_queue_t *rq = &run_queues[cpuid];
+
+    // nothing runnable on any cpu: run the idle pcb(bubble)
+    pcb_t *next = &pid0_pcbs[cpuid];
+
+    balance_run_queue(cpuid);
+
+    // the local queue only holds ready tasks, deadline tasks run
+    // ahead of best-effort ones, whose policy chooses among them
+    pcb_t *picked = dl_sched_class.pick_next_task(rq);
+    if (picked == NULL) {
+        picked = sched_class->pick_next_task(rq);
+    }
+    if (picked != NULL) {
+        next = picked;
+        dequeue_task(next);
     }
 
-    // go through ready_queue
-    pcb_t *p;
-    list_for_each_entry(p, &ready_queue) {
-        if (p->status == TASK_RUNNING) continue;
-        idle_pcb = p;
-        break;
+    set_next_task(next, cpuid);
+}
+
+// directed yield: the caller has blocked or requeued current_running,
+// hand this cpu straight to the ready task `to` and donate the rest of
+// the slice of current_running, so `to` runs until that slice is over.
+// return 0 if `to` cannot run here, the caller schedules as usual then
+int yield_to(pcb_t *to) {
+    int cpuid = get_current_cpu_id();
+    pcb_t *curr = current_running;
+
+    if (to == NULL || to->status != TASK_READY || to->bw_throttled || !cpu_allowed(to, cpuid)) return 0;
+
+    // deadline tasks keep their order and their cpu
+    if (is_dl_task(to) || dl_sched_class.pick_next_task(&run_queues[cpuid]) != NULL) return 0;
+
+    if (to->cpu != cpuid) move_task(to, cpuid);
+    dequeue_task(to);
+
+    uint64_t used = 0;
+    if (!is_idle_task(curr) && !is_dl_task(curr)) {
+        used = curr->sum_exec_runtime - curr->slice_start;
     }
-        
-    finish:
-        current_running = idle_pcb;
-        current_running->status = TASK_RUNNING;
-        runnings[cpuid] = current_running;
 
-        swap_in_all_pages(current_running->pgdir);
+    set_next_task(to, cpuid);
+    to->slice_start = to->sum_exec_runtime - used;
+    return 1;
 }
 
-void do_scheduler(void)
+// put the running task back to the run queue and switch to the next one
+static void schedule(void)
 {
-    // Check sleep queue to wake up PCBs
-    check_sleeping();
-    
-    // Check send/recv queue to unblock PCBs
-    // FIXME: Please uncomment the following code after implementing file system
-    check_net_send();
-    check_net_recv();
-
     // Modify the current_running pointer.
     pcb_t *before_running = current_running;
     before_running->status = TASK_READY;
 
     // check if before_running is pcb0(bubble)
-    if (before_running != &pid0_pcb && before_running != &pid0_pcb2) {
-        list_delete_entry(&before_running->list);
-        list_add_tail(&before_running->list, &ready_queue);
+    if (!is_idle_task(before_running)) {
+        enqueue_task(before_running, get_current_cpu_id());
     }
 
     // current_running is modified in function `find_idle_task`
@@ -114,65 +465,355 @@ void do_scheduler(void)
     switch_to(before_running, current_running);
 }
 
+// wake up the tasks whose events have come, then take sched_lock:
+// net waiters are woken up under net_lock, which comes before it
+static void check_events_and_lock(void)
+{
+    // Check send/recv queue to unblock PCBs
+    check_net_send();
+    check_net_recv();
+
+    spin_lock_acquire(&sched_lock);
+
+    // Fire expired timers to wake up sleeping PCBs
+    check_timers();
+}
+
+// sys_yield
+void do_scheduler(void)
+{
+    check_events_and_lock();
+    update_curr();
+
+    pcb_t *curr = current_running;
+    trace_event(TRACE_YIELD, curr, 0);
+    if (!is_idle_task(curr) && task_sched_class(curr)->yield_task != NULL) {
+        task_sched_class(curr)->yield_task(&run_queues[get_current_cpu_id()], curr);
+    }
+    schedule();
+    spin_lock_release(&sched_lock);
+}
+
+// timer interrupt: the policy decides whether the running task is preempted
+void scheduler_tick(void)
+{
+    check_events_and_lock();
+    update_curr();
+
+    pcb_t *curr = current_running;
+    int cpuid = get_current_cpu_id();
+    run_queue_t *rq = &run_queues[cpuid];
+    int resched = is_idle_task(curr) || task_sched_class(curr)->task_tick(rq, curr);
+
+    // the cpu_mask of the running task no longer holds this cpu
+    if (!is_idle_task(curr) && !cpu_allowed(curr, cpuid)) {
+        resched = 1;
+    }
+
+    // the group of the running task used up its quota
+    if (!is_idle_task(curr) && bw_check_throttle(curr)) {
+        resched = 1;
+    }
+
+    // a ready deadline task preempts best-effort ones at once
+    if (!is_dl_task(curr) && dl_sched_class.pick_next_task(rq) != NULL) {
+        resched = 1;
+    }
+
+    if (resched) schedule();
+    spin_lock_release(&sched_lock);
+}
+
+// reschedule IPI: another cpu queued work for this idle cpu, changed
+// the cpu_mask of the running task, throttled its group, or woke up a
+// deadline task which preempts it
+void scheduler_ipi(void)
+{
+    spin_lock_acquire(&sched_lock);
+    update_curr();
+
+    // the work may have been picked up before the IPI came
+    pcb_t *curr = current_running;
+    int cpuid = get_current_cpu_id();
+    if (is_idle_task(curr) || !cpu_allowed(curr, cpuid) || task_bw_throttled(curr) ||
+        dl_preempts_curr(&run_queues[cpuid])) {
+        schedule();
+    }
+    spin_lock_release(&sched_lock);
+}
+
+static void sleep_timeout(void *arg)
+{
+    pcb_t *p = (pcb_t *)arg;
+    trace_event(TRACE_TIMER, p, 0);
+    do_unblock_locked(&p->list);
+}
+
+// dynamic tick: program the timer of this cpu for the next event it
+// really has to handle instead of interrupting it every TIMER_INTERVAL.
+// runs without sched_lock on the way out of the kernel, a value read
+// while another cpu changes it only moves the next interrupt
+void update_timer(void)
+{
+    int cpuid = get_current_cpu_id();
+    uint64_t now = get_ticks();
+    uint64_t next;
+
+    if (nr_ready_tasks() != 0 || net_has_waiters()) {
+        // other tasks are waiting for a time slice (or to be stolen),
+        // and blocked net tasks are woken up by polling
+        next = now + TIMER_INTERVAL;
+    } else {
+        // idle, or exactly one runnable task: sleep until the earliest timer
+        next = next_timer_expiry();
+        if (next > now + TICKLESS_MAX_INTERVAL) {
+            next = now + TICKLESS_MAX_INTERVAL;
+        }
+    }
+
+    // a deadline task is throttled as soon as its budget runs out
+    pcb_t *curr = current_running;
+    if (is_dl_task(curr) && now + curr->dl_budget < next) {
+        next = now + curr->dl_budget;
+    }
+
+    // and a task of a limited group when its group runs out of quota
+    if (task_bw_limited(curr) && curr->bw_group->runtime > 0 &&
+        now + curr->bw_group->runtime < next) {
+        next = now + curr->bw_group->runtime;
+    }
+
+    // the armed timer is kept unless it fired or comes too late
+    if (timer_armed[cpuid] <= now || next < timer_armed[cpuid]) {
+        set_timer(next);
+        timer_armed[cpuid] = next;
+    }
+}
+
 void do_sleep(uint32_t sleep_time)
 {
     // sleep(seconds)
     // assume: 1 second = 1 `timebase` ticks
     // 1. block the current_running
-    // 2. set the wake up time for the blocked task
+    // 2. arm the sleep timer of the blocked task
     // 3. reschedule because the current_running is blocked.
     pcb_t *gonna_sleep = current_running;
-    gonna_sleep->wakeup_time = get_timer() + sleep_time;
+    timer_add(&gonna_sleep->sleep_timer, get_ticks() + sleep_time * time_base);
+
+    do_block(&gonna_sleep->list, &sleep_queue, &sched_lock);
+}
 
-    do_block(&gonna_sleep->list, &sleep_queue);
+void do_block(list_node_t *pcb_node, list_head *queue, spin_lock_t *lock)
+{
+    do_block_to(pcb_node, queue, lock, 0, 0);
 }
 
-void do_block(list_node_t *pcb_node, list_head *queue)
+// block the running task and switch directly to thread `to_tid` of
+// process `to_pid` if it is still alive and can run here, the fast
+// path of a task that blocks waiting for its partner. a pid of 0 is no
+// partner. the caller holds `lock`, which protects `queue`: it is
+// released once the task is queued and held again when the task runs on
+void do_block_to(list_node_t *pcb_node, list_head *queue, spin_lock_t *lock, pid_t to_pid, pthread_t to_tid)
 {
+    if (lock != &sched_lock) spin_lock_acquire(&sched_lock);
+
     // block the pcb task into the block queue
     list_delete_entry(pcb_node);
     list_add_tail(pcb_node, queue);
 
     pcb_t *before_running = list_entry(pcb_node, pcb_t);
     before_running->status = TASK_BLOCKED;
+    trace_event(TRACE_BLOCK, before_running, 0);
+    update_curr();
+    if (task_sched_class(before_running)->block_task != NULL) {
+        task_sched_class(before_running)->block_task(&run_queues[get_current_cpu_id()], before_running);
+    }
 
-    find_idle_task();
+    // a waker takes `lock` before sched_lock, so it cannot
+    // wake the task up before it has switched away
+    if (lock != &sched_lock) spin_lock_release(lock);
+
+    pcb_t *to = to_pid == 0 ? NULL : find_thread(to_pid, to_tid);
+    if (!yield_to(to)) {
+        find_idle_task();
+    }
     switch_pgdir();
     switch_to(before_running, current_running);
+
+    if (lock != &sched_lock) {
+        spin_lock_release(&sched_lock);
+        spin_lock_acquire(lock);
+    }
 }
 
 void do_unblock(list_node_t *pcb_node)
+{
+    spin_lock_acquire(&sched_lock);
+    do_unblock_locked(pcb_node);
+    spin_lock_release(&sched_lock);
+}
+
+// do_unblock for callers holding sched_lock
+void do_unblock_locked(list_node_t *pcb_node)
 {
     // unblock the `pcb` from the block queue
     list_delete_entry(pcb_node);
 
+    // the woken task is queued on the cpu that wakes it up
     pcb_t *wakeup = list_entry(pcb_node, pcb_t);
-    wakeup->status = TASK_READY;
-    list_add_tail(pcb_node, &ready_queue);
+    trace_event(TRACE_UNBLOCK, wakeup, current_running->pid);
+    if (is_dl_task(wakeup)) dl_task_woken(wakeup);
+    enqueue_task(wakeup, get_current_cpu_id());
+    wake_up_idle_cpu(wakeup);
 }
 
+// like most scheduler syscalls it runs under sched_lock, see init_syscall
 void do_process_show() {
     printk("[Process Table]:\n");
 
-    for (int i = 0; i < NUM_MAX_TASK; i++) {
-        if (pcb[i].pid != 0) {
-            printk("[%d] NAME: %s  PID: %d  STATUS: %s\n", i, pcb[i].name, pcb[i].pid, status[pcb[i].status]);
+    int i = 0;
+    list_node_t *node;
+    for (node = task_list.next; node != &task_list; node = node->next, i++) {
+        pcb_t *p = list_entry_of(node, pcb_t, task_node);
+        if (is_dl_task(p)) {
+            printk("[%d] NAME: %s  PID: %d  TID: %d  STATUS: %s  MASK: 0x%x  DL MISSES: %d\n",
+                   i, p->name, p->pid, p->tid, status[p->status], p->cpu_mask, p->dl_misses);
+        } else {
+            printk("[%d] NAME: %s  PID: %d  TID: %d  STATUS: %s  MASK: 0x%x\n",
+                   i, p->name, p->pid, p->tid, status[p->status], p->cpu_mask);
         }
     }
+    printk("tasks: %d/%d, threads per process: %d\n", nr_tasks, max_tasks, max_threads);
 }
 
-static pcb_t *find_unused_pcb() {
-    for (int i = 0; i < NUM_MAX_TASK; i++) {
-        // find an unused pcb
-        if (pcb[i].pid == 0) {
-            return &pcb[i];
-            break;
-        }
+// scheduling state of a new task, its vruntime is placed on enqueue
+static void init_sched_entity(pcb_t *p, int nice) {
+    p->nice     = nice;
+    p->pi_nice  = nice;
+    p->weight   = nice_to_weight(nice);
+    p->pi_blocked_on = NULL;
+    INIT_LIST_HEAD(&p->pi_mutexes);
+    p->cond_mutex = NULL;
+    p->mlfq_level = 0;
+    p->mlfq_used = 0;
+    p->vruntime = 0;
+    heap_node_init(&p->run_node);
+    init_dl_entity(p);
+    p->bw_group         = NULL;
+    p->bw_throttled     = 0;
+    p->wakee_pid        = 0;
+    p->wakee_tid        = 0;
+    p->sum_exec_runtime = 0;
+    p->exec_start       = 0;
+    p->slice_start      = 0;
+    p->utime = p->stime = p->wait_time = 0;
+    p->nvcsw = p->nivcsw = 0;
+}
+
+void init_tasks(void) {
+    slab_cache_init(&pcb_cache, sizeof(pcb_t));
+    for (int i = 0; i < PID_HASH_SIZE; i++) {
+        INIT_LIST_HEAD(&pid_hash[i]);
+        INIT_LIST_HEAD(&tid_hash[i]);
+    }
+}
+
+static inline list_head *pid_bucket(pid_t pid) {
+    return &pid_hash[pid & (PID_HASH_SIZE - 1)];
+}
+
+static inline list_head *tid_bucket(pid_t pid, pthread_t tid) {
+    return &tid_hash[(pid * 31 + tid) & (PID_HASH_SIZE - 1)];
+}
+
+// a live thread of process `pid`, the one created first
+pcb_t *find_task(pid_t pid) {
+    list_head *bucket = pid_bucket(pid);
+    for (list_node_t *node = bucket->next; node != bucket; node = node->next) {
+        pcb_t *p = list_entry_of(node, pcb_t, pid_node);
+        if (p->pid == pid) return p;
     }
+    return NULL;
+}
 
+pcb_t *find_thread(pid_t pid, pthread_t tid) {
+    list_head *bucket = tid_bucket(pid, tid);
+    for (list_node_t *node = bucket->next; node != bucket; node = node->next) {
+        pcb_t *p = list_entry_of(node, pcb_t, tid_node);
+        if (p->pid == pid && p->tid == tid) return p;
+    }
     return NULL;
 }
 
+static int nr_threads(pid_t pid) {
+    int nr = 0;
+    list_head *bucket = pid_bucket(pid);
+    for (list_node_t *node = bucket->next; node != bucket; node = node->next) {
+        if (list_entry_of(node, pcb_t, pid_node)->pid == pid) nr++;
+    }
+    return nr;
+}
+
+// threads of process `pid` which are not on their way out
+static int nr_live_threads(pid_t pid) {
+    int nr = 0;
+    list_head *bucket = pid_bucket(pid);
+    for (list_node_t *node = bucket->next; node != bucket; node = node->next) {
+        pcb_t *p = list_entry_of(node, pcb_t, pid_node);
+        if (p->pid == pid && !p->exiting) nr++;
+    }
+    return nr;
+}
+
+// the smallest tid not used by a live thread of process `pid`
+static pthread_t alloc_tid(pid_t pid) {
+    pthread_t tid = 1;
+    while (find_thread(pid, tid) != NULL) tid++;
+    return tid;
+}
+
+static void free_pcb(pcb_t *p) {
+    // the kernel stack holds the trapframe at its top
+    kfree(ROUNDDOWN((ptr_t)p->trapframe, PAGE_SIZE));
+    slab_free(&pcb_cache, p);
+    nr_tasks--;
+}
+
+// free the pcbs of exited tasks: a task exits holding sched_lock until
+// it switched away, and a task running on another cpu is never released
+// by its killer, so no cpu runs a zombie any longer
+static void reap_zombies(void) {
+    while (!is_queue_empty(&zombie_list)) {
+        pcb_t *p = list_entry(zombie_list.next, pcb_t);
+        list_delete_entry(&p->list);
+        free_pcb(p);
+    }
+}
+
+// a cleared pcb, or NULL if there are max_tasks tasks already
+static pcb_t *alloc_pcb(void) {
+    reap_zombies();
+    if (nr_tasks >= max_tasks) return NULL;
+
+    pcb_t *p = (pcb_t *)slab_alloc(&pcb_cache);
+    memset(p, 0, sizeof(pcb_t));
+    nr_tasks++;
+    return p;
+}
+
+// make a task with pid and tid set visible to lookups
+static void hash_pcb(pcb_t *p) {
+    list_add_tail(&p->task_node, &task_list);
+    list_add_tail(&p->pid_node, pid_bucket(p->pid));
+    list_add_tail(&p->tid_node, tid_bucket(p->pid, p->tid));
+}
+
+static void unhash_pcb(pcb_t *p) {
+    list_delete_entry(&p->task_node);
+    list_delete_entry(&p->pid_node);
+    list_delete_entry(&p->tid_node);
+}
+
 static void init_pcb_context(pcb_t *p) {
     ptr_t kernel_stack      = (ptr_t)kalloc() + PAGE_SIZE;
     ptr_t user_stack        = alloc_page_helper(USER_VA_SP_BASE, (PTE *)p->pgdir) + PAGE_SIZE;
@@ -191,7 +832,7 @@ static void init_pcb_context(pcb_t *p) {
     pt_regs->sstatus |= SR_SUM;
 
     switchto_context_t *pt_switchto = (switchto_context_t *)((ptr_t)pt_regs - sizeof(switchto_context_t));
-    pt_switchto->regs[0] = (ptr_t)ret_from_kernel;  // ra
+    pt_switchto->regs[0] = (ptr_t)ret_from_fork;    // ra
     pt_switchto->regs[1] = (ptr_t)pt_regs;          // sp
         
     p->kernel_sp        = (ptr_t)pt_regs;
@@ -200,53 +841,79 @@ static void init_pcb_context(pcb_t *p) {
     p->switchto_context = pt_switchto;
 }
 
-pcb_t *create_pcb(char *name) {
-    // try to find unused pcb
-    pcb_t *p = find_unused_pcb();
-    // if cannot find an unused pcb, return NULL for failure
-    if (p == NULL) return NULL;
-
-    int task_found = 0;
-    for (int i = 0; i < NUM_MAX_TASK; i++) {
+pcb_t *create_pcb(char *name, uint32_t cpu_mask) {
+    // find the task with given name in tasks array
+    int task_idx = -1;
+    for (int i = 0; i < tasks_num; i++) {
         if (strcmp(name, tasks[i].name) == 0) {
-            task_found = 1;
-
-            p->pid    = process_id++;
-            p->tid    = ++(threads[p->pid]);
-            p->status = TASK_READY;
-            strcpy(p->name, name);
-            list_add_tail(&p->list, &ready_queue);
-            INIT_LIST_HEAD(&p->wait_list);
-
-            // allocate a page as pagetable for this process
-            // then read the SD card, copy the content of SD card
-            // to this pagetable
-            p->pgdir = (PTE *)kalloc();
-            assert(load_task_img(tasks[i].name, (PTE *)p->pgdir) == 1);
-
-            // map kernel pagetable to user pagetable
-            share_pgtable(p->pgdir, (PTE *)PGDIR_VA);
-
-            // initialize stacks(kernel & user) and
-            // contexts(trapframe & switchto) of pcb
-            init_pcb_context(p);
+            task_idx = i;
             break;
         }
     }
 
     // cannot find a task from tasks array with given name
     // return NULL for failure
-    if (task_found == 0) return NULL;
+    if (task_idx < 0) return NULL;
+
+    // if cannot allocate a pcb, return NULL for failure
+    spin_lock_acquire(&sched_lock);
+    pcb_t *p = alloc_pcb();
+    if (p != NULL) {
+        p->pid = process_id++;
+        p->tid = alloc_tid(p->pid);
+    }
+    spin_lock_release(&sched_lock);
+    if (p == NULL) return NULL;
 
-    // successfully created a pcb
-    // return the address the pcb
+    strcpy(p->name, name);
+    INIT_LIST_HEAD(&p->list);
+    INIT_LIST_HEAD(&p->wait_list);
+    timer_init(&p->sleep_timer, sleep_timeout, p);
+    init_sched_entity(p, 0);
+    p->cpu_mask = cpu_mask;
+
+    // allocate a page as pagetable for this process
+    // then read the SD card, copy the content of SD card
+    // to this pagetable
+    p->pgdir = alloc_pgdir();
+    spin_lock_acquire(&mm_lock);
+    assert(load_task_img(tasks[task_idx].name, (PTE *)p->pgdir) == 1);
+
+    // map kernel pagetable to user pagetable
+    share_pgtable(p->pgdir, (PTE *)PGDIR_VA);
+
+    // initialize stacks(kernel & user) and
+    // contexts(trapframe & switchto) of pcb
+    init_pcb_context(p);
+    spin_lock_release(&mm_lock);
+
+    // successfully created a pcb, it is set up without sched_lock
+    // and only seen by others after `wake_up_new_task`
     return p;
 }
 
+// make a task returned by `create_pcb` visible and runnable
+void wake_up_new_task(pcb_t *p) {
+    spin_lock_acquire(&sched_lock);
+    hash_pcb(p);
+    enqueue_task(p, get_current_cpu_id());
+    wake_up_idle_cpu(p);
+    spin_lock_release(&sched_lock);
+}
 
+
+// a new process inherits the cpu_mask of its parent
 pid_t do_exec(char *name, int argc, char *argv[]) {
-    pcb_t *p = create_pcb(name);
-    
+    return do_taskset_exec(name, argc, argv, current_running->cpu_mask);
+}
+
+// exec with the cpus the new process may run on
+pid_t do_taskset_exec(char *name, int argc, char *argv[], uint32_t mask) {
+    mask &= CPU_MASK_ALL;
+    if (mask == 0) return 0;
+
+    pcb_t *p = create_pcb(name, mask);
+
     // create pcb failed, return 0 for failure
     if (p == NULL) return 0;
 
@@ -281,104 +948,161 @@ pid_t do_exec(char *name, int argc, char *argv[]) {
 
     p->cwd_inum = current_running->cwd_inum;
 
-    return p->pid;
+    // the new task may exit before we return
+    pid_t pid = p->pid;
+    wake_up_new_task(p);
+    return pid;
 }
 
 static void release_pcb(pcb_t *p) {
-    p->status = TASK_EXITED;
-    threads[p->pid]--;
+    // remove the task from list(run queue, block_queue, etc);
+    if (p->status == TASK_READY) {
+        dequeue_task(p);
+    } else {
+        list_delete_entry(&p->list);
+    }
 
-    // remove the task from list(ready_queue, block_queue, etc);
-    list_delete_entry(&p->list);
+    p->status = TASK_EXITED;
+    unhash_pcb(p);
 
-    // release all the locks that exited is holding
-    for (int i = 0; i < LOCK_NUM; i++) {
-        if (mlocks[i].pid == p->pid) {
-            do_mutex_lock_release(i);
-        }
-    }
+    // a sleeping task must not be woken up after it is gone
+    timer_del(&p->sleep_timer);
+    exit_dl_entity(p);
 
     // wakeup processes that are waiting for current_running to exit
     list_head *wait_list = &p->wait_list;
     while (!is_queue_empty(wait_list)) {
-        do_unblock(wait_list->next);
+        do_unblock_locked(wait_list->next);
+    }
+
+    // the pcb is freed by `reap_zombies`
+    list_add_tail(&p->list, &zombie_list);
+}
+
+// free the user memory of a released task: the whole address space
+// with its last thread, or else only the user stack of the thread
+static void free_task_memory(pcb_t *p) {
+    spin_lock_acquire(&mm_lock);
+
+    // killed in a futex wait
+    futex_unpin(p);
+
+    if (find_task(p->pid) == NULL) {
+        free_pagetable(p->pgdir);
+    } else {
+        uint64_t thread_stack_base_kva = p->user_sp - PAGE_SIZE;
+        free_page_with_kva(thread_stack_base_kva);
     }
+    spin_lock_release(&mm_lock);
 }
 
 void do_exit(void) {
     // release current_running
     pcb_t *exited = current_running;
+
+    // of several threads exiting at once, only the one which comes
+    // last here sees no live sibling
+    spin_lock_acquire(&sched_lock);
+    exited->exiting = 1;
+    int last_live = nr_live_threads(exited->pid) == 0;
+    spin_lock_release(&sched_lock);
+
+    // mutexes are handed over under ipc_lock, which comes before sched_lock
+    release_task_mutexes(&exited->pi_mutexes, exited->pid, last_live);
+
+    spin_lock_acquire(&sched_lock);
     release_pcb(exited);
 
     // if no threads of current process is running
     // free pagetable, page directory and then switch pagetable
     // else, only free the user stack page allocated for the thread
-    if (threads[exited->pid] == 0) {
-        free_pagetable(exited->pgdir);
+    int last_thread = find_task(exited->pid) == NULL;
+    free_task_memory(exited);
 
-        find_idle_task();
-        switch_pgdir();
-        free_pgdir(exited->pgdir);
-    } else {
-        uint64_t thread_stack_base_kva = exited->user_sp - PAGE_SIZE;
-        free_page_with_kva(thread_stack_base_kva);
-    }
+    find_idle_task();
+    switch_pgdir();
+    if (last_thread) free_pgdir(exited->pgdir);
 
-    exited->pid = 0;
     switch_to(exited, current_running);
 }
 
 int do_kill(pid_t pid) {
-    pcb_t *killed = NULL;
-    for (int i = 0; i < NUM_MAX_TASK; i++) {
-        if (pcb[i].pid == pid) {
-            killed = &pcb[i];
-            break;
+    // a blocked task may wait in a queue of the ipc or net subsystem,
+    // which is only changed under its lock
+    spin_lock_acquire(&ipc_lock);
+    spin_lock_acquire(&net_lock);
+    spin_lock_acquire(&sched_lock);
+
+    pcb_t *killed = find_task(pid);
+    int released = 0, last_live = 0;
+    list_head orphans;
+    INIT_LIST_HEAD(&orphans);
+
+    if (killed != NULL && killed != current_running) {
+        if (killed->status == TASK_RUNNING) {
+            // it may be in the middle of a syscall on its cpu, so it
+            // exits by itself when it enters or leaves the kernel next
+            killed->killed = 1;
+            send_resched_ipi(killed->cpu);
+        } else {
+            disown_task_mutexes(killed, &orphans);
+            cancel_cond_wait(killed);
+            release_pcb(killed);
+            last_live = nr_live_threads(pid) == 0;
+            int last_thread = find_task(killed->pid) == NULL;
+            free_task_memory(killed);
+            if (last_thread) free_pgdir(killed->pgdir);
+            released = 1;
         }
     }
 
-    if (killed == NULL) return 0;
-
-    release_pcb(killed);
+    spin_lock_release(&sched_lock);
+    spin_lock_release(&net_lock);
+    spin_lock_release(&ipc_lock);
 
-    // if no threads of current process is running
-    // free pagetable, page directory and then switch pagetable
-    // else, only free the user stack page allocated for the thread
-    if (threads[killed->pid] == 0) {
-        free_pagetable(killed->pgdir);
-        free_pgdir(killed->pgdir);
-    } else {
-        uint64_t thread_stack_base_kva = killed->user_sp - PAGE_SIZE;
-        free_page_with_kva(thread_stack_base_kva);
-    }
+    // a task killing itself never returns
+    if (killed != NULL && killed == current_running) do_exit();
 
-    killed->pid = 0;
-    return 1;
+    if (released) release_task_mutexes(&orphans, pid, last_live);
+    return killed != NULL;
 }
 
 pthread_t do_thread_create(long start_routine, long arg) {
-    pcb_t *p = find_unused_pcb();
+    pcb_t *main_thread = current_running;
+    if (nr_threads(main_thread->pid) >= max_threads) return 0;
+
+    pcb_t *p = alloc_pcb();
     if (p == NULL) return 0;
 
-    pcb_t *main_thread = current_running;
     p->pid    = main_thread->pid;
-    p->tid    = ++threads[p->pid];
-    p->status = TASK_READY;
+    p->tid    = alloc_tid(p->pid);
 
     strcpy(p->name, main_thread->name);
-    list_add_tail(&p->list, &ready_queue);
+    INIT_LIST_HEAD(&p->list);
     INIT_LIST_HEAD(&p->wait_list);
+    timer_init(&p->sleep_timer, sleep_timeout, p);
+
+    // a thread inherits the nice value and vruntime of its creator
+    init_sched_entity(p, main_thread->nice);
+    p->vruntime = main_thread->vruntime;
+    p->cpu_mask = main_thread->cpu_mask;
+    p->cwd_inum = main_thread->cwd_inum;
+    p->bw_group = main_thread->bw_group;
 
     // all threads of a process share pagetable
     p->pgdir = main_thread->pgdir;
 
     ptr_t kernel_stack  = (ptr_t)kalloc() + PAGE_SIZE;
     ptr_t user_stack_uva = USER_VA_SP_BASE + (p->tid - 1) * PAGE_SIZE;
+
+    // other threads of the process may fault on the same pagetable
+    spin_lock_acquire(&mm_lock);
     ptr_t user_stack    = alloc_page_helper(user_stack_uva, p->pgdir) + PAGE_SIZE;
 
     // stack page should not hold attribute EXEC
     PTE *user_stack_pte = get_pte_of_uva(user_stack_uva, p->pgdir);
     unset_attribute(user_stack_pte, _PAGE_EXEC);
+    spin_lock_release(&mm_lock);
 
     regs_context_t *pt_regs = (regs_context_t *)(kernel_stack - sizeof(regs_context_t));
     pt_regs->regs[2] = user_stack_uva + PAGE_SIZE;  // sp
@@ -391,7 +1115,7 @@ pthread_t do_thread_create(long start_routine, long arg) {
     pt_regs->sstatus |= SR_SUM;
 
     switchto_context_t *pt_switchto = (switchto_context_t *)((ptr_t)pt_regs - sizeof(switchto_context_t));
-    pt_switchto->regs[0] = (ptr_t)ret_from_kernel;  // ra
+    pt_switchto->regs[0] = (ptr_t)ret_from_fork;    // ra
     pt_switchto->regs[1] = (ptr_t)pt_regs;          // sp
         
     p->kernel_sp        = (ptr_t)pt_regs;
@@ -399,15 +1123,18 @@ pthread_t do_thread_create(long start_routine, long arg) {
     p->trapframe        = pt_regs;
     p->switchto_context = pt_switchto;
 
+    hash_pcb(p);
+    enqueue_task(p, get_current_cpu_id());
+    wake_up_idle_cpu(p);
     return p->tid;
 }
 
 pthread_t do_thread_join(pthread_t thread) {
-    pcb_t *p, *p_q;
-    list_for_each_entry_safe(p, p_q, &ready_queue) {
-        if (p->pid == current_running->pid && p->tid == thread) {
-            do_block(&current_running->list, &p->wait_list);
-        }
+    // running threads are not kept in any run queue,
+    // so look the thread up in the tid hash instead
+    pcb_t *p = find_thread(current_running->pid, thread);
+    if (p != NULL && p != current_running) {
+        do_block(&current_running->list, &p->wait_list, &sched_lock);
     }
 
     return thread;
@@ -417,18 +1144,191 @@ pid_t do_getpid() {
     return runnings[get_current_cpu_id()]->pid;
 }
 
-int do_waitpid(pid_t pid) {
-    pcb_t *to_wait = NULL;
+// run `p` with the nice value `pi_nice`, its own or one inherited
+// through a mutex, see lock.c. called with sched_lock held
+void set_task_pi_nice(pcb_t *p, int pi_nice) {
+    if (p->pi_nice == pi_nice) return;
 
-    for (int i = 0; i < NUM_MAX_TASK; i++) {
-        if (pcb[i].pid == pid) {
-            to_wait = &pcb[i];
-            break;
+    int queued = p->status == TASK_READY;
+    if (queued) dequeue_task(p);
+
+    p->pi_nice = pi_nice;
+    p->weight  = nice_to_weight(pi_nice);
+
+    if (queued) enqueue_task(p, p->cpu);
+}
+
+// set the nice value of all threads of process `pid`, 0 for the caller
+// return 1 for success, 0 for invalid nice or no such process
+int do_nice(pid_t pid, int nice) {
+    if (nice < NICE_MIN || nice > NICE_MAX) return 0;
+    if (pid == 0) pid = current_running->pid;
+
+    int found = 0;
+    list_head *bucket = pid_bucket(pid);
+    for (list_node_t *node = bucket->next; node != bucket; node = node->next) {
+        pcb_t *p = list_entry_of(node, pcb_t, pid_node);
+        if (p->pid != pid) continue;
+
+        // the weight of a queued task is part of the load of its queue
+        int queued = p->status == TASK_READY;
+        if (queued) dequeue_task(p);
+
+        // a boost inherited from a mutex waiter lasts until the mutex is released
+        int boosted = p->pi_nice < p->nice;
+        p->nice    = nice;
+        p->pi_nice = boosted && p->pi_nice < nice ? p->pi_nice : nice;
+        p->weight  = nice_to_weight(p->pi_nice);
+
+        if (queued) enqueue_task(p, p->cpu);
+        found = 1;
+    }
+
+    return found;
+}
+
+// set the cpu_mask of all threads of process `pid`, 0 for the caller.
+// ready threads move to an allowed cpu at once, a running one on
+// another cpu is sent a reschedule IPI to leave it.
+// return 1 for success, 0 for an empty mask, no such process, or a
+// deadline task whose admitted cpu is left out of the mask
+int do_taskset(pid_t pid, uint32_t mask) {
+    mask &= CPU_MASK_ALL;
+    if (mask == 0) return 0;
+    if (pid == 0) pid = current_running->pid;
+
+    // check all threads first, the mask of a process is changed as a whole
+    int found = 0;
+    list_head *bucket = pid_bucket(pid);
+    list_node_t *node;
+    for (node = bucket->next; node != bucket; node = node->next) {
+        pcb_t *p = list_entry_of(node, pcb_t, pid_node);
+        if (p->pid != pid) continue;
+
+        if (is_dl_task(p) && !((mask >> p->dl_cpu) & 1)) return 0;
+        found = 1;
+    }
+    if (!found) return 0;
+
+    for (node = bucket->next; node != bucket; node = node->next) {
+        pcb_t *p = list_entry_of(node, pcb_t, pid_node);
+        if (p->pid != pid) continue;
+
+        p->cpu_mask = mask;
+        if (p->status == TASK_READY && !cpu_allowed(p, p->cpu)) {
+            move_task(p, select_task_cpu(p, p->cpu));
+            wake_up_idle_cpu(p);
+        } else if (p->status == TASK_RUNNING && p != current_running && !cpu_allowed(p, p->cpu)) {
+            send_resched_ipi(p->cpu);
         }
     }
 
+    // the caller leaves a cpu it may no longer run on at once
+    if (!cpu_allowed(current_running, get_current_cpu_id())) {
+        update_curr();
+        schedule();
+    }
+    return 1;
+}
+
+int do_waitpid(pid_t pid) {
+    pcb_t *to_wait = find_task(pid);
     if (to_wait == NULL) return 0;
 
-    do_block(&current_running->list, &to_wait->wait_list);
-    return to_wait->pid;
+    do_block(&current_running->list, &to_wait->wait_list, &sched_lock);
+    return pid;
+}
+
+// change the limits on live tasks and on threads per process, a
+// limit of 0 is left unchanged. return 1 for success, 0 for a limit
+// out of range or below the tasks alive right now
+int do_task_limit(int tasks, int threads) {
+    if (tasks < 0 || tasks > NUM_MAX_TASK) return 0;
+    if (threads < 0 || threads > NUM_MAX_TASK) return 0;
+
+    reap_zombies();
+    if (tasks != 0 && tasks < nr_tasks) return 0;
+
+    if (tasks != 0) max_tasks = tasks;
+    if (threads != 0) max_threads = threads;
+    return 1;
+}
+
+// switch all normal tasks to `policy`, one of SCHED_*: the ready ones
+// move from the queues of the old policy to those of the new one, the
+// running ones are queued by the new one once they stop. every task
+// starts again at the top mlfq level. return 0 for an unknown policy
+int do_sched_policy(int policy) {
+    if (policy < SCHED_RR || policy > SCHED_MLFQ) return 0;
+
+    const sched_class_t *new_class = policy_classes[policy];
+    if (new_class == sched_class) return 1;
+
+    list_node_t *node;
+    for (node = task_list.next; node != &task_list; node = node->next) {
+        pcb_t *p = list_entry_of(node, pcb_t, task_node);
+        p->mlfq_level = 0;
+        p->mlfq_used = 0;
+
+        // deadline tasks and throttled ones are not in these queues
+        if (p->status != TASK_READY || is_idle_task(p) || is_dl_task(p) || p->bw_throttled) continue;
+
+        run_queue_t *rq = &run_queues[p->cpu];
+        sched_class->dequeue_task(rq, p);
+        new_class->enqueue_task(rq, p);
+    }
+
+    uint64_t now = get_ticks();
+    for (int i = 0; i < NR_CPUS; i++) {
+        run_queues[i].last_boost = now;
+    }
+
+    sched_class = new_class;
+    return 1;
+}
+
+// fill `cpus` with the busy and idle ticks of up to `ncpus` cpus and
+// `tasks` with the statistics of up to `ntasks` live tasks, times
+// include the run in progress. return the number of tasks filled
+int do_sched_stat(cpu_stat_t *cpus, int ncpus, task_stat_t *tasks, int ntasks) {
+    uint64_t now = get_ticks();
+    int cpuid = get_current_cpu_id();
+
+    for (int i = 0; i < nr_cpus && i < ncpus; i++) {
+        cpus[i] = cpu_stats[i];
+        if (is_idle_task(runnings[i])) {
+            cpus[i].idle += now - cpu_stamp[i];
+        } else {
+            cpus[i].busy += now - cpu_stamp[i];
+        }
+    }
+
+    int n = 0;
+    list_node_t *node;
+    for (node = task_list.next; node != &task_list && n < ntasks; node = node->next, n++) {
+        pcb_t *p = list_entry_of(node, pcb_t, task_node);
+        task_stat_t *st = &tasks[n];
+
+        st->pid    = p->pid;
+        st->tid    = p->tid;
+        strcpy(st->name, p->name);
+        st->status = p->status;
+        st->cpu    = p->cpu;
+        st->nice   = p->nice;
+        st->utime  = p->utime;
+        st->stime  = p->stime;
+        st->wait_time = p->wait_time;
+        st->nvcsw  = p->nvcsw;
+        st->nivcsw = p->nivcsw;
+
+        // the caller is in the kernel, other running tasks in user mode
+        if (p == current_running) {
+            st->stime += now - p->mode_start;
+        } else if (p->status == TASK_RUNNING && runnings[p->cpu] == p && p->cpu != cpuid) {
+            st->utime += now - p->mode_start;
+        } else if (p->status == TASK_READY) {
+            st->wait_time += now - p->wait_start;
+        }
+    }
+    return n;
 }
@@ -1,6 +1,7 @@
-#include <os/list.h>
-#include <os/sched.h>
+#include <os/time.h>
+#include <os/heap.h>
 #include <type.h>
+#include <assert.h>
 
 uint64_t time_elapsed = 0;
 uint64_t time_base = 0;
@@ -23,6 +24,11 @@ uint64_t get_time_base()
     return time_base;
 }
 
+uint64_t us_to_ticks(uint64_t us)
+{
+    return us * time_base / 1000000;
+}
+
 void latency(uint64_t time)
 {
     uint64_t begin_time = get_timer();
@@ -31,13 +37,64 @@ void latency(uint64_t time)
     return;
 }
 
-void check_sleeping(void)
+// armed timers, ordered by expiry time, under sched_lock. the expiry
+// of the earliest one is cached for `update_timer`, which runs unlocked
+static heap_t timer_heap;
+static volatile uint64_t first_expiry = UINT64_MAX;
+
+static void update_first_expiry(void)
+{
+    heap_node_t *node = heap_peek(&timer_heap);
+    first_expiry = node == NULL ? UINT64_MAX : node->key;
+}
+
+void init_timers(void)
+{
+    heap_init(&timer_heap);
+}
+
+void timer_init(timer_t *timer, void (*callback)(void *), void *arg)
+{
+    heap_node_init(&timer->node);
+    timer->callback = callback;
+    timer->arg = arg;
+}
+
+// arm `timer` to fire at `expires`(ticks), re-arming a pending timer moves it
+void timer_add(timer_t *timer, uint64_t expires)
 {
-    // Pick out tasks that should wake up from the sleep queue
-    pcb_t *p, *p_q;
-    list_for_each_entry_safe(p, p_q, &sleep_queue) {
-        if (get_timer() >= p->wakeup_time) {
-            do_unblock(&p->list);
-        }
+    if (heap_node_queued(&timer->node)) {
+        heap_update(&timer_heap, &timer->node, expires);
+    } else {
+        timer->node.key = expires;
+        assert(heap_push(&timer_heap, &timer->node));
+    }
+    update_first_expiry();
+}
+
+void timer_del(timer_t *timer)
+{
+    heap_remove(&timer_heap, &timer->node);
+    update_first_expiry();
+}
+
+// expiry time of the earliest timer, UINT64_MAX if no timer is armed
+uint64_t next_timer_expiry(void)
+{
+    return first_expiry;
+}
+
+void check_timers(void)
+{
+    // only the expired timers are touched: they are all at the top of the heap
+    uint64_t now = get_ticks();
+    heap_node_t *node;
+
+    while ((node = heap_peek(&timer_heap)) != NULL && node->key <= now) {
+        heap_pop(&timer_heap);
+
+        timer_t *timer = heap_entry(node, timer_t, node);
+        timer->callback(timer->arg);
     }
+    update_first_expiry();
 }
\ No newline at end of file
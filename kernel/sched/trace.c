@@ -0,0 +1,98 @@
+#include <os/trace.h>
+#include <os/sched.h>
+#include <os/smp.h>
+#include <os/time.h>
+#include <atomic.h>
+
+// one ring per cpu: the cpu itself is the only writer of its ring and
+// moves `head`, the reader moves `tail`, so recording takes no lock.
+// readers are serialized by sched_lock, which the syscall runs under
+typedef struct trace_ring
+{
+    trace_event_t events[TRACE_RING_SIZE];
+    volatile uint32_t head;     // next slot the cpu writes
+    volatile uint32_t tail;     // next slot to be drained
+    uint32_t dropped;           // events lost to a full ring
+} trace_ring_t;
+
+static trace_ring_t trace_rings[NR_CPUS];
+
+int trace_enabled = 0;
+
+void __trace_event(trace_type_t type, pcb_t *p, int arg)
+{
+    int cpu = get_current_cpu_id();
+    trace_ring_t *ring = &trace_rings[cpu];
+    uint32_t head = ring->head;
+
+    if (head - ring->tail >= TRACE_RING_SIZE) {
+        ring->dropped++;
+        return;
+    }
+
+    trace_event_t *ev = &ring->events[head & (TRACE_RING_SIZE - 1)];
+    ev->time = get_ticks();
+    ev->type = type;
+    ev->cpu  = cpu;
+    ev->pid  = p->pid;
+    ev->tid  = p->tid;
+    ev->arg  = arg;
+
+    // the event is written before it is published
+    smp_mb();
+    ring->head = head + 1;
+}
+
+// move up to `n` events of `ring` into `buf`
+static int trace_drain(trace_ring_t *ring, trace_event_t *buf, int n)
+{
+    uint32_t tail = ring->tail;
+    uint32_t head = ring->head;
+    int copied = 0;
+
+    // read the events only after their head was seen
+    smp_mb();
+    for (; tail != head && copied < n; tail++, copied++) {
+        buf[copied] = ring->events[tail & (TRACE_RING_SIZE - 1)];
+    }
+
+    // the slots are handed back once copied
+    smp_mb();
+    ring->tail = tail;
+    return copied;
+}
+
+// TRACE_START clears the rings and starts recording, TRACE_STOP stops
+// it and TRACE_READ drains up to `n` events into `buf`, cpu by cpu, each
+// in time order. return the number of events read, or for start/stop
+// the events dropped since the last start
+int do_sched_trace(int cmd, trace_event_t *buf, int n)
+{
+    int ret = 0;
+
+    switch (cmd) {
+        case TRACE_START:
+            trace_enabled = 0;
+            for (int i = 0; i < NR_CPUS; i++) {
+                trace_rings[i].tail = trace_rings[i].head;
+                trace_rings[i].dropped = 0;
+            }
+            smp_mb();
+            trace_enabled = 1;
+            break;
+        case TRACE_STOP:
+            trace_enabled = 0;
+            for (int i = 0; i < NR_CPUS; i++) {
+                ret += trace_rings[i].dropped;
+            }
+            break;
+        case TRACE_READ:
+            for (int i = 0; i < NR_CPUS && ret < n; i++) {
+                ret += trace_drain(&trace_rings[i], buf + ret, n - ret);
+            }
+            break;
+        default:
+            ret = -1;
+    }
+    return ret;
+}
@@ -1,46 +1,51 @@
-#include <atomic.h>
-#include <os/sched.h>
-#include <os/smp.h>
-#include <os/lock.h>
-#include <os/kernel.h>
-
-extern spin_lock_t kernel_spin_lock;
-
-void smp_init()
-{
-    spin_lock_acquire(&kernel_spin_lock);
-}
-
-void wakeup_other_hart()
-{
-    send_ipi(NULL);
-    asm volatile("csrw sip, zero");
-}
-
-void lock_kernel()
-{
-    while (spin_lock_try_acquire(&kernel_spin_lock) == LOCKED);
-}
-
-void unlock_kernel()
-{
-    spin_lock_release(&kernel_spin_lock);
-}
-
-void slave_wait_for_task() {
-    // at the initial stage, only master processor is carrying out tasks
-    // therefore, slave processor should wait until
-    // there are more than 2 tasks in ready_queue
-    // which means ready_queue.next->next != &ready_queue
-    while (1) {
-        if (is_queue_empty(&ready_queue) || ready_queue.next->next == &ready_queue) {
-            unlock_kernel();                             // less than 2 tasks
-        } else {                                         // 2 or more tasks
-            runnings[1] = list_entry(ready_queue.next->next, pcb_t);
-            current_running = runnings[1];
-            current_running->status = TASK_RUNNING;
-            break;
-        }
-        lock_kernel();
-    }
-}
\ No newline at end of file
+#include <atomic.h>
+#include <os/sched.h>
+#include <os/smp.h>
+#include <os/lock.h>
+#include <os/time.h>
+#include <os/kernel.h>
+
+int nr_cpus = 1;
+volatile uint32_t cpu_online_mask = 1;
+
+// wake up the secondary harts one at a time: they enter the kernel on
+// the same boot stack and map the boot address into the shared pgdir
+// again on their way to `main`. the BIOS does not tell the number of
+// harts, so it is the number which check in: the first hart which does
+// not show up in time is not there, and no hart after it is tried
+void smp_boot_secondaries()
+{
+    for (int i = 1; i < NR_CPUS; i++) {
+        unsigned long hart_mask = 1ul << i;
+        send_ipi(&hart_mask);
+
+        // a present hart is online well within 10ms, even under qemu
+        uint64_t timeout = get_ticks() + time_base / 100;
+        while (!cpu_online(i) && get_ticks() < timeout);
+        if (!cpu_online(i)) break;
+
+        nr_cpus = i + 1;
+    }
+}
+
+// a secondary hart is set up and may be given tasks from now on,
+// the harts come up one by one so the mask has a single writer
+void set_cpu_online(int cpu)
+{
+    smp_mb();
+    cpu_online_mask |= 1u << cpu;
+}
+
+// ask `cpu` to reschedule, see `scheduler_ipi`
+void send_resched_ipi(int cpu)
+{
+    unsigned long hart_mask = 1ul << cpu;
+    send_ipi(&hart_mask);
+}
+
+void slave_wait_for_task() {
+    // at the initial stage, only master processor is carrying out tasks.
+    // the slave processor steals a ready task if there is one, or else
+    // runs its idle pcb until a reschedule IPI says work was queued
+    find_idle_task();
+}
@@ -9,6 +9,7 @@
 #define REG_POS_A7      17    /* Index of a7 register in regs_context_t->regs */
 
 long (*syscall[NUM_SYSCALLS])();
+spin_lock_t *syscall_lock[NUM_SYSCALLS];
 
 void handle_syscall(regs_context_t *regs, uint64_t interrupt, uint64_t cause)
 {
@@ -20,6 +21,12 @@ void handle_syscall(regs_context_t *regs, uint64_t interrupt, uint64_t cause)
     long arg3 = regs->regs[REG_POS_A3];
     long arg4 = regs->regs[REG_POS_A4];
 
+    // a syscall which never blocks may run under the lock of its subsystem
+    spin_lock_t *lock = syscall_lock[syscall_number];
+    if (lock != NULL) spin_lock_acquire(lock);
+
     regs->regs[REG_POS_A0] = syscall[syscall_number](arg0, arg1, arg2, arg3, arg4);
     regs->sepc += 4;
+
+    if (lock != NULL) spin_lock_release(lock);
 }
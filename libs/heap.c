@@ -0,0 +1,112 @@
+#include <os/heap.h>
+#include <os/mm.h>
+#include <assert.h>
+
+static inline heap_node_t **heap_slot(heap_t *heap, int i)
+{
+    return &heap->pages[i / HEAP_PAGE_NODES][i % HEAP_PAGE_NODES];
+}
+
+static inline heap_node_t *heap_get(heap_t *heap, int i)
+{
+    return *heap_slot(heap, i);
+}
+
+static void heap_set(heap_t *heap, int i, heap_node_t *node)
+{
+    *heap_slot(heap, i) = node;
+    node->index = i;
+}
+
+static void sift_up(heap_t *heap, int i)
+{
+    heap_node_t *node = heap_get(heap, i);
+
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (heap_get(heap, parent)->key <= node->key) break;
+        heap_set(heap, i, heap_get(heap, parent));
+        i = parent;
+    }
+    heap_set(heap, i, node);
+}
+
+static void sift_down(heap_t *heap, int i)
+{
+    heap_node_t *node = heap_get(heap, i);
+
+    for (;;) {
+        int child = 2 * i + 1;
+        if (child >= heap->size) break;
+        if (child + 1 < heap->size && heap_get(heap, child + 1)->key < heap_get(heap, child)->key) {
+            child++;
+        }
+        if (node->key <= heap_get(heap, child)->key) break;
+        heap_set(heap, i, heap_get(heap, child));
+        i = child;
+    }
+    heap_set(heap, i, node);
+}
+
+void heap_init(heap_t *heap)
+{
+    assert(HEAP_PAGE_NODES * sizeof(heap_node_t *) == PAGE_SIZE);
+
+    heap->pages    = NULL;
+    heap->size     = 0;
+    heap->capacity = 0;
+}
+
+// add a page of node pointers
+static void heap_grow(heap_t *heap)
+{
+    if (heap->pages == NULL) {
+        heap->pages = (heap_node_t ***)kalloc();
+    }
+    heap->pages[heap->capacity / HEAP_PAGE_NODES] = (heap_node_t **)kalloc();
+    heap->capacity += HEAP_PAGE_NODES;
+}
+
+// return 0 if the heap has HEAP_MAX_NODES nodes already
+int heap_push(heap_t *heap, heap_node_t *node)
+{
+    if (heap->size >= HEAP_MAX_NODES) return 0;
+    if (heap->size >= heap->capacity) heap_grow(heap);
+
+    heap_set(heap, heap->size++, node);
+    sift_up(heap, node->index);
+    return 1;
+}
+
+heap_node_t *heap_pop(heap_t *heap)
+{
+    heap_node_t *top = heap_peek(heap);
+    if (top != NULL) heap_remove(heap, top);
+    return top;
+}
+
+void heap_remove(heap_t *heap, heap_node_t *node)
+{
+    int i = node->index;
+    if (i < 0) return;
+
+    node->index = -1;
+    heap->size--;
+    if (i == heap->size) return;
+
+    // move the last node into the hole, then restore the heap order
+    heap_node_t *last = heap_get(heap, heap->size);
+    heap_set(heap, i, last);
+    sift_up(heap, i);
+    sift_down(heap, last->index);
+}
+
+// change the key of a node which is already in the heap
+void heap_update(heap_t *heap, heap_node_t *node, uint64_t key)
+{
+    node->key = key;
+    if (node->index < 0) return;
+
+    sift_up(heap, node->index);
+    sift_down(heap, node->index);
+}
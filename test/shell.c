@@ -50,14 +50,18 @@ const char *commands[] = {
     "clear", "ps", "exec", "kill",
     "mkfs", "statfs", "mkdir", "ls",
     "cd", "rmdir", "touch", "cat",
-    "ln", "rm"
+    "ln", "rm", "nice", "deadline",
+    "taskset", "ulimit", "top", "cpuquota",
+    "cpugroup", "policy"
 };
 
 enum cmds {
     CLEAR, PS, EXEC, KILL,
     MKFS, STATFS, MKDIR, LS,
     CD, RMDIR, TOUCH, CAT,
-    LN, RM
+    LN, RM, NICE, DEADLINE,
+    TASKSET, ULIMIT, TOP, CPUQUOTA,
+    CPUGROUP, POLICY
 } cmd_enum;
 
 static inline void init_shell();
@@ -66,6 +70,7 @@ static inline void backspace();
 static void read_keyboard(char *buf);
 static void clear_buf(char *buf, int size);
 static void parse_input(char *buf);
+static void top(int rounds);
 
 int main(void)
 {
@@ -127,6 +132,85 @@ static void read_keyboard(char *buf) {
     }
 }
 
+#define TOP_MAX_CPUS  8
+#define TOP_MAX_TASKS 64
+
+// two samples of the statistics, usage is the difference between them
+static cpu_stat_t  top_cpus[2][TOP_MAX_CPUS];
+static task_stat_t top_tasks[2][TOP_MAX_TASKS];
+static int top_ntasks[2];
+
+static const char *top_status[] = {"BLOCKED", "RUNNING", "READY", "EXITED"};
+
+// names of the scheduling policies, indexed by SCHED_*
+static const char *policies[] = {"rr", "fair", "mlfq"};
+
+static long ticks_to_ms(uint64_t ticks) {
+    return ticks * 1000 / sys_get_timebase();
+}
+
+// the sample of the same thread taken last time, or NULL for a new one
+static task_stat_t *top_find_prev(task_stat_t *st, int prev) {
+    for (int i = 0; i < top_ntasks[prev]; i++) {
+        task_stat_t *p = &top_tasks[prev][i];
+        if (p->pid == st->pid && p->tid == st->tid) return p;
+    }
+    return NULL;
+}
+
+// refresh cpu usage of harts and tasks every second, until a key is
+// pressed or `rounds` refreshes are shown (0 for no limit)
+static void top(int rounds) {
+    int cur = 0;
+    long last_tick = sys_get_tick();
+
+    bzero(top_cpus, sizeof(top_cpus));
+    top_ntasks[cur] = sys_sched_stat(top_cpus[cur], TOP_MAX_CPUS, top_tasks[cur], TOP_MAX_TASKS);
+
+    for (int round = 0; rounds == 0 || round < rounds; round++) {
+        sys_sleep(1);
+
+        int prev = cur;
+        cur ^= 1;
+        top_ntasks[cur] = sys_sched_stat(top_cpus[cur], TOP_MAX_CPUS, top_tasks[cur], TOP_MAX_TASKS);
+
+        long now = sys_get_tick();
+        uint64_t elapsed = now - last_tick;
+        last_tick = now;
+        if (elapsed == 0) elapsed = 1;
+
+        sys_clear();
+        init_shell();
+        printf("top: refreshed every second, press any key to quit\n");
+
+        // cpus which do not exist are never filled
+        for (int i = 0; i < TOP_MAX_CPUS; i++) {
+            cpu_stat_t *c = &top_cpus[cur][i], *p = &top_cpus[prev][i];
+            if (c->busy + c->idle == 0) continue;
+
+            printf("cpu%d: busy %d%%  busy %ldms  idle %ldms\n", i,
+                   (int)((c->busy - p->busy) * 100 / elapsed),
+                   ticks_to_ms(c->busy), ticks_to_ms(c->idle));
+        }
+
+        printf("PID TID NAME  STATUS  CPU NICE  %%CPU  USER(ms) SYS(ms) WAIT(ms)  VCSW IVCSW\n");
+        for (int i = 0; i < top_ntasks[cur]; i++) {
+            task_stat_t *st = &top_tasks[cur][i];
+            task_stat_t *p  = top_find_prev(st, prev);
+
+            uint64_t used = st->utime + st->stime;
+            if (p != NULL) used -= p->utime + p->stime;
+
+            printf("%d %d %s  %s  %d %d  %d%%  %ld %ld %ld  %ld %ld\n",
+                   st->pid, st->tid, st->name, top_status[st->status], st->cpu, st->nice,
+                   (int)(used * 100 / elapsed), ticks_to_ms(st->utime), ticks_to_ms(st->stime),
+                   ticks_to_ms(st->wait_time), st->nvcsw, st->nivcsw);
+        }
+
+        if (sys_getchar() != -1) break;
+    }
+}
+
 static void clear_buf(char *buf, int size) {
     for (int i = 0; i < size; i++) {
         buf[i] = 0;
@@ -140,7 +224,7 @@ static void parse_input(char *buf) {
     pid_t pid;
     
     char *path = NULL, *option_str = NULL;
-    int option = 0;
+    int option = 0, policy;
 
     for (int i = 0; i < MAX_ARG; i++) {
         argv[i] = NULL;
@@ -235,6 +319,87 @@ static void parse_input(char *buf) {
         case RM:
             sys_rm(argv[0]);
             break;
+        case NICE:
+            if (argc == 2 && sys_nice(atoi(argv[0]), atoi(argv[1]))) {
+                printf("set nice of pid %s to %s.\n", argv[0], argv[1]);
+            } else {
+                printf("usage: nice <pid> <-20..19>\n");
+            }
+            break;
+        case DEADLINE:
+            if (argc == 4 && sys_sched_deadline(atoi(argv[0]), atol(argv[1]), atol(argv[2]), atol(argv[3])) == 1) {
+                printf("set deadline parameters of pid %s.\n", argv[0]);
+            } else {
+                printf("usage: deadline <pid> <runtime> <deadline> <period>(us), rejected on overload\n");
+            }
+            break;
+        case TASKSET:
+            // taskset -p <mask> <pid>: change the mask of a running process
+            if (argc == 3 && !strcmp(argv[0], "-p")) {
+                if (sys_taskset(atoi(argv[2]), atoi(argv[1]))) {
+                    printf("set cpu mask of pid %s to %s.\n", argv[2], argv[1]);
+                } else {
+                    printf("set cpu mask of pid %s failed!\n", argv[2]);
+                }
+                break;
+            }
+
+            // taskset <mask> <name> [args]: execute on the cpus of mask
+            if (argc < 2 || argv[0][0] == '-') {
+                printf("usage: taskset <mask> <name> [args] | taskset -p <mask> <pid>\n");
+                break;
+            }
+            pid = sys_taskset_exec(argv[1], argc - 1, argv + 1, atoi(argv[0]));
+            if (pid > 0) {
+                printf("execute %s successfully, pid = %d.\n", argv[1], pid);
+            } else {
+                printf("execute %s failed!\n", argv[1]);
+            }
+
+            if (wait && pid != 0) {
+                sys_waitpid(pid);
+            }
+            break;
+        case TOP:
+            // top [rounds]
+            top(argc >= 1 ? atoi(argv[0]) : 0);
+            break;
+        case CPUQUOTA:
+            // quota 0 lifts the limit of the group
+            if (argc == 3 && sys_cpu_quota(atoi(argv[0]), atol(argv[1]), atol(argv[2]))) {
+                printf("set quota of group %s to %sus every %sus.\n", argv[0], argv[1], argv[2]);
+            } else {
+                printf("usage: cpuquota <group 1..16> <quota> <period>(us)\n");
+            }
+            break;
+        case CPUGROUP:
+            // group 0 takes the process out of its group
+            if (argc == 2 && sys_cpu_group(atoi(argv[0]), atoi(argv[1]))) {
+                printf("moved pid %s to group %s.\n", argv[1], argv[0]);
+            } else {
+                printf("usage: cpugroup <group> <pid>, the group needs a quota\n");
+            }
+            break;
+        case ULIMIT:
+            // 0 keeps a limit unchanged, the current limits are shown by ps
+            if (argc == 2 && sys_task_limit(atoi(argv[0]), atoi(argv[1]))) {
+                printf("set task limits to %s tasks, %s threads per process.\n", argv[0], argv[1]);
+            } else {
+                printf("usage: ulimit <max tasks> <max threads>(0: unchanged)\n");
+            }
+            break;
+        case POLICY:
+            // the policy of all tasks but the deadline ones
+            policy = -1;
+            for (int i = 0; argc == 1 && i < ARR_SIZE(policies); i++) {
+                if (!strcmp(argv[0], policies[i])) policy = i;
+            }
+            if (policy >= 0 && sys_sched_policy(policy)) {
+                printf("switched to %s scheduling.\n", argv[0]);
+            } else {
+                printf("usage: policy <rr|fair|mlfq>\n");
+            }
+            break;
         default:
             printf("Error: Unknown Command %s\n", buf);
     }
@@ -0,0 +1,105 @@
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+// futexes between processes: the first task execs the others, and all
+// of them increment a counter in a share page under a pthread mutex,
+// meet at a pthread barrier and check the sum. then the first one
+// hands a token around with a condition until every task had it once
+// usage: exec futex [print_location]
+
+#define MAGIC 0xfeedfacefeedfacelu
+#define SHMP_KEY 43
+#define NUM_TASKS 4
+#define NUM_ITERS 2000
+
+typedef struct futex_vars {
+    atomic_long magic_number;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    pthread_barrier_t barrier;
+    atomic_int nr_joined;
+    long counter;
+    int token;
+} futex_vars_t;
+
+static int is_first(futex_vars_t *vars)
+{
+    unsigned long my = atomic_exchange_d(&vars->magic_number, MAGIC);
+    return my != MAGIC;
+}
+
+static void exec_others(char *name, int print_location)
+{
+    char str_print_loc[10];
+    char *args[2] = {name, str_print_loc};
+
+    for (int i = 1; i < NUM_TASKS; i++) {
+        itoa(print_location + i, str_print_loc, 10, 10);
+        sys_exec(name, 2, args);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int print_location = argc > 1 ? atoi(argv[1]) : 1;
+
+    futex_vars_t *vars = (futex_vars_t *)sys_shmpageget(SHMP_KEY);
+    if (vars == NULL) {
+        sys_move_cursor(1, print_location);
+        printf("> [FUTEX] shmpageget failed!\n");
+        return -1;
+    }
+
+    // the others are started once the page is set up, and all of them
+    // wait until everybody is there to contend for the mutex
+    int my_id = 0;
+    if (is_first(vars)) {
+        pthread_mutex_init(&vars->lock);
+        pthread_cond_init(&vars->cond);
+        pthread_barrier_init(&vars->barrier, NUM_TASKS);
+        vars->counter = 0;
+        vars->token = 0;
+        atomic_exchange(&vars->nr_joined, 1);
+        exec_others(argv[0], print_location);
+    } else {
+        my_id = fetch_add(&vars->nr_joined, 1);
+    }
+    while (atomic_load((volatile uint32_t *)&vars->nr_joined) < NUM_TASKS) {
+        sys_yield();
+    }
+
+    for (int i = 0; i < NUM_ITERS; i++) {
+        pthread_mutex_lock(&vars->lock);
+        vars->counter++;
+        pthread_mutex_unlock(&vars->lock);
+    }
+    pthread_barrier_wait(&vars->barrier);
+
+    // the token goes from task to task in the order of their ids
+    pthread_mutex_lock(&vars->lock);
+    while (vars->token != my_id) {
+        pthread_cond_wait(&vars->cond, &vars->lock);
+    }
+    vars->token++;
+    pthread_cond_broadcast(&vars->cond);
+    pthread_mutex_unlock(&vars->lock);
+
+    pthread_barrier_wait(&vars->barrier);
+
+    sys_move_cursor(1, print_location);
+    long expected = (long)NUM_TASKS * NUM_ITERS;
+    if (vars->counter == expected && vars->token == NUM_TASKS) {
+        printf("> [FUTEX] (%d) task %d passed, counter %ld\n", sys_getpid(), my_id, vars->counter);
+    } else {
+        printf("> [FUTEX] (%d) task %d FAILED, counter %ld of %ld, token %d\n",
+               sys_getpid(), my_id, vars->counter, expected, vars->token);
+    }
+
+    // everybody has read the results before the page goes away
+    pthread_barrier_wait(&vars->barrier);
+    sys_shmpagedt((void *)vars);
+    return 0;
+}
@@ -0,0 +1,110 @@
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+// time threads which increment a shared counter under a lock, once with
+// a futex mutex (pthread_mutex_t) and once with a kernel mutex
+// (sys_mutex_acquire), and print the ticks each took. a last round runs
+// a writer preferring pthread_rwlock_t: one writer increments while
+// the other threads keep taking it for reading, it must not hang
+// usage: exec lockbench [threads] [iterations] [print_location]
+
+#define MAX_THREADS 8
+#define LOCK_KEY    77
+
+enum {
+    BENCH_KERNEL,
+    BENCH_FUTEX,
+    BENCH_RWLOCK,
+};
+
+static int nr_threads, nr_iters;
+static int bench;
+
+static pthread_mutex_t futex_mutex;
+static pthread_rwlock_t rwlock;
+static int kernel_mutex;
+static volatile long counter;
+
+static void rw_worker(long id)
+{
+    for (int i = 0; i < nr_iters; i++) {
+        if (id == 0) {
+            pthread_rwlock_wrlock(&rwlock);
+            counter++;
+            pthread_rwlock_unlock(&rwlock);
+        } else {
+            pthread_rwlock_rdlock(&rwlock);
+            long seen = counter;
+            if (seen != counter) printf("> [LOCKBENCH] reader saw a write\n");
+            pthread_rwlock_unlock(&rwlock);
+        }
+    }
+}
+
+static void worker(void *arg)
+{
+    if (bench == BENCH_RWLOCK) {
+        rw_worker((long)arg);
+        sys_exit();
+    }
+
+    int use_futex = bench == BENCH_FUTEX;
+    for (int i = 0; i < nr_iters; i++) {
+        if (use_futex) {
+            pthread_mutex_lock(&futex_mutex);
+            counter++;
+            pthread_mutex_unlock(&futex_mutex);
+        } else {
+            sys_mutex_acquire(kernel_mutex);
+            counter++;
+            sys_mutex_release(kernel_mutex);
+        }
+    }
+    sys_exit();
+}
+
+static long run(int which)
+{
+    pthread_t threads[MAX_THREADS];
+
+    bench = which;
+    counter = 0;
+
+    long start = sys_get_tick();
+    for (long i = 0; i < nr_threads; i++) {
+        pthread_create(&threads[i], worker, (void *)i);
+    }
+    for (int i = 0; i < nr_threads; i++) {
+        pthread_join(threads[i]);
+    }
+    return sys_get_tick() - start;
+}
+
+int main(int argc, char *argv[])
+{
+    nr_threads = argc > 1 ? atoi(argv[1]) : 2;
+    nr_iters   = argc > 2 ? atoi(argv[2]) : 10000;
+    int print_location = argc > 3 ? atoi(argv[3]) : 0;
+    if (nr_threads < 1 || nr_threads > MAX_THREADS) nr_threads = 2;
+
+    pthread_mutex_init(&futex_mutex);
+    pthread_rwlock_init(&rwlock, 1);
+    kernel_mutex = sys_mutex_init(LOCK_KEY);
+
+    long futex_ticks = run(BENCH_FUTEX);
+    long futex_count = counter;
+    long kernel_ticks = run(BENCH_KERNEL);
+    long kernel_count = counter;
+    long rwlock_ticks = run(BENCH_RWLOCK);
+    long rwlock_count = counter;
+
+    sys_move_cursor(0, print_location);
+    printf("> [LOCKBENCH] %d threads x %d iterations\n", nr_threads, nr_iters);
+    printf("  futex mutex:  %ld ticks, counter %ld\n", futex_ticks, futex_count);
+    printf("  kernel mutex: %ld ticks, counter %ld\n", kernel_ticks, kernel_count);
+    printf("  rwlock, 1 writer: %ld ticks, counter %ld\n", rwlock_ticks, rwlock_count);
+
+    return 0;
+}
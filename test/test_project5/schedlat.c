@@ -0,0 +1,117 @@
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+// trace the scheduler for a few seconds and print a histogram of the
+// wakeup latency: the time from a task being made ready (TRACE_UNBLOCK)
+// until it gets a cpu (TRACE_SWITCH_IN)
+// usage: exec schedlat [seconds] [print_location]
+
+#define MAX_EVENTS   2048
+#define MAX_PENDING  64
+#define NR_BUCKETS   16         // bucket i: [2^(i-1), 2^i) us, 0: < 1us
+
+typedef struct pending
+{
+    pid_t pid;
+    pthread_t tid;
+    uint64_t time;
+} pending_t;
+
+static trace_event_t events[MAX_EVENTS];
+static pending_t pendings[MAX_PENDING];
+static int nr_pending;
+
+static long hist[NR_BUCKETS];
+static long nr_samples;
+static uint64_t max_latency, sum_latency;
+
+static long time_base;
+
+static uint64_t ticks_to_us(uint64_t ticks) {
+    return ticks * 1000000 / time_base;
+}
+
+// the rings of all cpus are drained one after another, merge them
+static void sort_events(int n) {
+    for (int i = 1; i < n; i++) {
+        trace_event_t ev = events[i];
+        int j = i - 1;
+        for (; j >= 0 && events[j].time > ev.time; j--) {
+            events[j + 1] = events[j];
+        }
+        events[j + 1] = ev;
+    }
+}
+
+static pending_t *find_pending(pid_t pid, pthread_t tid) {
+    for (int i = 0; i < nr_pending; i++) {
+        if (pendings[i].pid == pid && pendings[i].tid == tid) return &pendings[i];
+    }
+    return NULL;
+}
+
+static void add_sample(uint64_t latency) {
+    uint64_t us = ticks_to_us(latency);
+    int bucket = 0;
+    while (bucket < NR_BUCKETS - 1 && (1lu << bucket) <= us) bucket++;
+
+    hist[bucket]++;
+    nr_samples++;
+    sum_latency += us;
+    if (us > max_latency) max_latency = us;
+}
+
+static void process_events(int n) {
+    sort_events(n);
+
+    for (int i = 0; i < n; i++) {
+        trace_event_t *ev = &events[i];
+        if (ev->pid == 0) continue;         // idle pcb
+
+        pending_t *p = find_pending(ev->pid, ev->tid);
+        if (ev->type == TRACE_UNBLOCK) {
+            if (p == NULL && nr_pending < MAX_PENDING) p = &pendings[nr_pending++];
+            if (p == NULL) continue;
+
+            p->pid  = ev->pid;
+            p->tid  = ev->tid;
+            p->time = ev->time;
+        } else if (ev->type == TRACE_SWITCH_IN && p != NULL) {
+            add_sample(ev->time - p->time);
+            *p = pendings[--nr_pending];
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int seconds = argc > 1 ? atoi(argv[1]) : 5;
+    int print_location = argc > 2 ? atoi(argv[2]) : 0;
+    time_base = sys_get_timebase();
+
+    sys_move_cursor(0, print_location);
+    printf("> [SCHEDLAT] tracing for %d seconds...\n", seconds);
+
+    sys_sched_trace(TRACE_START, NULL, 0);
+    for (int i = 0; i < seconds; i++) {
+        sys_sleep(1);
+        process_events(sys_sched_trace(TRACE_READ, events, MAX_EVENTS));
+    }
+    int dropped = sys_sched_trace(TRACE_STOP, NULL, 0);
+    process_events(sys_sched_trace(TRACE_READ, events, MAX_EVENTS));
+
+    printf("> [SCHEDLAT] %ld wakeups, avg %ldus, max %ldus, %d events dropped\n",
+           nr_samples, nr_samples ? sum_latency / nr_samples : 0, max_latency, dropped);
+    for (int i = 0; i < NR_BUCKETS; i++) {
+        if (hist[i] == 0) continue;
+        if (i == 0) {
+            printf("      < 1us: %ld\n", hist[i]);
+        } else {
+            printf("  < %ldus: %ld\n", 1lu << i, hist[i]);
+        }
+    }
+
+    return 0;
+}
@@ -1,6 +1,7 @@
 #ifndef PTHREAD_H_
 #define PTHREAD_H_
 #include "unistd.h"
+#include "stdatomic.h"
 
 void pthread_create(pthread_t *thread,
                    void (*start_routine)(void*),
@@ -8,5 +9,55 @@ void pthread_create(pthread_t *thread,
 
 int pthread_join(pthread_t thread);
 
+/* mutex, condition and barrier on futexes: they live in user memory, the
+   threads of a process or processes sharing the page can use them, and
+   only a thread which has to wait enters the kernel */
+typedef struct pthread_mutex
+{
+    atomic_int state;       /* 0 unlocked, 1 locked, 2 locked with waiters */
+} pthread_mutex_t;
 
-#endif
\ No newline at end of file
+typedef struct pthread_cond
+{
+    atomic_int seq;         /* bumped by every signal and broadcast */
+} pthread_cond_t;
+
+typedef struct pthread_barrier
+{
+    atomic_int count;
+    atomic_int generation;  /* bumped each time the barrier opens */
+    int goal;
+} pthread_barrier_t;
+
+/* readers only enter the kernel to wait for a writer */
+#define PTHREAD_RWLOCK_WRITER 0x40000000    /* state: a writer holds it */
+#define PTHREAD_RWLOCK_READERS 0x3fffffff   /* state: readers holding it */
+
+typedef struct pthread_rwlock
+{
+    atomic_int state;
+    atomic_int seq;                 /* bumped by every unlock, waited on */
+    atomic_int waiters;             /* readers and writers asleep */
+    atomic_int writers_waiting;
+    int prefer_writer;
+} pthread_rwlock_t;
+
+void pthread_mutex_init(pthread_mutex_t *mutex);
+void pthread_mutex_lock(pthread_mutex_t *mutex);
+int  pthread_mutex_trylock(pthread_mutex_t *mutex);
+void pthread_mutex_unlock(pthread_mutex_t *mutex);
+
+void pthread_cond_init(pthread_cond_t *cond);
+void pthread_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex);
+void pthread_cond_signal(pthread_cond_t *cond);
+void pthread_cond_broadcast(pthread_cond_t *cond);
+
+void pthread_barrier_init(pthread_barrier_t *barrier, int goal);
+void pthread_barrier_wait(pthread_barrier_t *barrier);
+
+void pthread_rwlock_init(pthread_rwlock_t *rwlock, int prefer_writer);
+void pthread_rwlock_rdlock(pthread_rwlock_t *rwlock);
+void pthread_rwlock_wrlock(pthread_rwlock_t *rwlock);
+void pthread_rwlock_unlock(pthread_rwlock_t *rwlock);
+
+#endif
@@ -71,6 +71,24 @@ static inline int atomic_exchange(volatile void* obj, int desired)
     return ret;
 }
 
+/* if *obj == expected, then *obj = desired; return the old *obj */
+static inline int atomic_compare_exchange(volatile void* obj, int expected, int desired)
+{
+    int ret;
+    register unsigned int rc;
+    __asm__ __volatile__ (
+        "0:	lr.w %0, %2\n"
+        "	bne  %0, %z3, 1f\n"
+        "	sc.w.rl %1, %z4, %2\n"
+        "	bnez %1, 0b\n"
+        "	fence rw, rw\n"
+        "1:\n"
+        : "=&r"(ret), "=&r"(rc), "+A" (*(uint32_t*)obj)
+        : "rJ"(expected), "rJ"(desired)
+        : "memory");
+    return ret;
+}
+
 static inline long atomic_exchange_d(volatile void* obj, long desired)
 {
     uint64_t ret;
@@ -9,6 +9,16 @@
 #define SYSCALL_PS 5
 #define SYSCALL_GETPID 6
 #define SYSCALL_YIELD 7
+#define SYSCALL_NICE 8
+#define SYSCALL_SCHED_DEADLINE 9
+#define SYSCALL_TASKSET 10
+#define SYSCALL_TASKSET_EXEC 11
+#define SYSCALL_TASK_LIMIT 12
+#define SYSCALL_SCHED_STAT 13
+#define SYSCALL_SCHED_TRACE 14
+#define SYSCALL_CPU_QUOTA 15
+#define SYSCALL_CPU_GROUP 16
+#define SYSCALL_SCHED_POLICY 17
 
 #define SYSCALL_WRITE 20
 #define SYSCALL_READCH 21
@@ -23,6 +33,7 @@
 #define SYSCALL_THREAD_CREATE 35
 #define SYSCALL_THREAD_JOIN 36
 
+#define SYSCALL_LOCK_DESTROY 39
 #define SYSCALL_LOCK_INIT 40
 #define SYSCALL_LOCK_ACQ 41
 #define SYSCALL_LOCK_RELEASE 42
@@ -46,6 +57,12 @@
 
 #define SYSCALL_SHM_GET 56
 #define SYSCALL_SHM_DT 57
+
+#define SYSCALL_FUTEX_WAIT 58
+#define SYSCALL_FUTEX_WAKE 59
+
+#define SYSCALL_MBOX_SEND_PAGES 60
+#define SYSCALL_MBOX_RECV_PAGES 61
 #define SYSCALL_NET_SEND 63
 #define SYSCALL_NET_RECV 64
 #define SYSCALL_FS_MKFS 65
@@ -64,4 +81,10 @@
 #define SYSCALL_FS_RM 78
 #define SYSCALL_FS_LSEEK 79
 
+#define SYSCALL_RWLOCK_INIT 80
+#define SYSCALL_RWLOCK_RDLOCK 81
+#define SYSCALL_RWLOCK_WRLOCK 82
+#define SYSCALL_RWLOCK_UNLOCK 83
+#define SYSCALL_RWLOCK_DESTROY 84
+
 #endif
\ No newline at end of file
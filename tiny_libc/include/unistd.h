@@ -5,6 +5,59 @@
 typedef int32_t pid_t;
 typedef pid_t pthread_t;
 
+/* scheduling statistics filled by sys_sched_stat, times are in ticks */
+typedef struct task_stat
+{
+    pid_t pid;
+    pthread_t tid;
+    char name[16];
+    int status;             /* 0 BLOCKED, 1 RUNNING, 2 READY, 3 EXITED */
+    int cpu;
+    int nice;
+    uint64_t utime;         /* in user mode */
+    uint64_t stime;         /* in kernel mode */
+    uint64_t wait_time;     /* ready, waiting for a cpu */
+    uint64_t nvcsw;         /* switched away blocking or exiting */
+    uint64_t nivcsw;        /* switched away still ready */
+} task_stat_t;
+
+typedef struct cpu_stat
+{
+    uint64_t busy;
+    uint64_t idle;
+} cpu_stat_t;
+
+/* scheduler events drained by sys_sched_trace */
+enum {
+    TRACE_SWITCH_IN,        /* pid got the cpu, arg: pid switched out */
+    TRACE_SWITCH_OUT,       /* pid left the cpu, arg: its status afterwards */
+    TRACE_BLOCK,            /* pid blocked */
+    TRACE_UNBLOCK,          /* pid made ready, arg: pid of the waker (0: idle) */
+    TRACE_TIMER,            /* a timer of pid fired */
+    TRACE_YIELD,            /* pid called sys_yield */
+};
+
+typedef struct trace_event
+{
+    uint64_t time;          /* ticks */
+    uint32_t type;
+    uint32_t cpu;
+    int32_t pid;
+    int32_t tid;
+    int32_t arg;
+    int32_t pad;
+} trace_event_t;
+
+/* commands of sys_sched_trace */
+#define TRACE_STOP  0
+#define TRACE_START 1
+#define TRACE_READ  2
+
+/* policies of sys_sched_policy */
+#define SCHED_RR    0
+#define SCHED_FAIR  1
+#define SCHED_MLFQ  2
+
 void sys_sleep(uint32_t time);
 void sys_yield(void);
 void sys_write(char *buff);
@@ -15,6 +68,7 @@ long sys_get_tick(void);
 int sys_mutex_init(int key);
 void sys_mutex_acquire(int mutex_idx);
 void sys_mutex_release(int mutex_idx);
+int sys_mutex_destroy(int mutex_idx);
 
 pthread_t sys_thread_create(void (*start_routine)(void *), void *arg);
 pthread_t sys_thread_join(pthread_t thread);
@@ -30,6 +84,16 @@ void sys_exit(void);
 int  sys_kill(pid_t pid);
 int  sys_waitpid(pid_t pid);
 pid_t sys_getpid();
+int  sys_nice(pid_t pid, int nice);
+int  sys_sched_deadline(pid_t pid, long runtime_us, long deadline_us, long period_us);
+int  sys_taskset(pid_t pid, uint32_t mask);
+pid_t sys_taskset_exec(char *name, int argc, char **argv, uint32_t mask);
+int  sys_task_limit(int tasks, int threads);
+int  sys_sched_stat(cpu_stat_t *cpus, int ncpus, task_stat_t *tasks, int ntasks);
+int  sys_sched_trace(int cmd, trace_event_t *buf, int n);
+int  sys_cpu_quota(int gid, long quota_us, long period_us);
+int  sys_cpu_group(int gid, pid_t pid);
+int  sys_sched_policy(int policy);
 
 
 int  sys_barrier_init(int key, int goal);
@@ -42,15 +106,31 @@ void sys_condition_signal(int cond_idx);
 void sys_condition_broadcast(int cond_idx);
 void sys_condition_destroy(int cond_idx);
 
+/* reader-writer locks, a queued writer holds off new readers
+   when initialized with RWLOCK_PREFER_WRITER */
+#define RWLOCK_PREFER_WRITER 1
+int  sys_rwlock_init(int key, int flags);
+void sys_rwlock_rdlock(int rw_idx);
+void sys_rwlock_wrlock(int rw_idx);
+void sys_rwlock_unlock(int rw_idx);
+int  sys_rwlock_destroy(int rw_idx);
+
 int sys_mbox_open(char * name);
+int sys_mbox_open_size(char * name, int capacity);
 void sys_mbox_close(int mbox_id);
 int sys_mbox_send(int mbox_idx, void *msg, int msg_length);
 int sys_mbox_recv(int mbox_idx, void *msg, int msg_length);
+int sys_mbox_send_pages(int mbox_idx, void *addr, int npages);
+int sys_mbox_recv_pages(int mbox_idx, void *addr, int npages);
 
 /* shmpageget/dt */
 void* sys_shmpageget(int key);
 void sys_shmpagedt(void *addr);
 
+/* futex: sleep while *addr == val, wake up at most n sleepers on addr */
+int sys_futex_wait(volatile int *addr, int val);
+int sys_futex_wake(volatile int *addr, int n);
+
 /* net send and recv */
 int sys_net_send(void *txpacket, int length);
 int sys_net_recv(void *rxbuffer, int pkt_num, int *pkt_lens);
@@ -1,4 +1,5 @@
 #include <pthread.h>
+#include <stdint.h>
 
 void pthread_create(pthread_t *thread,
                    void (*start_routine)(void*),
@@ -11,3 +12,179 @@ pthread_t pthread_join(pthread_t thread)
 {
     return sys_thread_join(thread);
 }
+
+void pthread_mutex_init(pthread_mutex_t *mutex)
+{
+    atomic_exchange(&mutex->state, 0);
+}
+
+// an uncontended lock and unlock are one amoswap each. a thread which
+// finds the mutex held sets it to 2, so the owner knows to wake it up
+void pthread_mutex_lock(pthread_mutex_t *mutex)
+{
+    if (atomic_exchange(&mutex->state, 1) == 0) return;
+
+    while (atomic_exchange(&mutex->state, 2) != 0) {
+        sys_futex_wait(&mutex->state, 2);
+    }
+}
+
+// return 1 if the mutex was taken, or 0 if it is held. a held mutex
+// is left alone, swapping it would hide its waiters from the unlock
+int pthread_mutex_trylock(pthread_mutex_t *mutex)
+{
+    return atomic_compare_exchange(&mutex->state, 0, 1) == 0;
+}
+
+void pthread_mutex_unlock(pthread_mutex_t *mutex)
+{
+    if (atomic_exchange(&mutex->state, 0) == 2) {
+        sys_futex_wake(&mutex->state, 1);
+    }
+}
+
+void pthread_cond_init(pthread_cond_t *cond)
+{
+    atomic_exchange(&cond->seq, 0);
+}
+
+// a signal after `seq` is read changes it, and then the futex wait
+// returns at once instead of missing the signal
+void pthread_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex)
+{
+    int seq = atomic_load((volatile uint32_t *)&cond->seq);
+
+    pthread_mutex_unlock(mutex);
+    sys_futex_wait(&cond->seq, seq);
+
+    // other waiters may be woken up with us, take the mutex as contended
+    while (atomic_exchange(&mutex->state, 2) != 0) {
+        sys_futex_wait(&mutex->state, 2);
+    }
+}
+
+void pthread_cond_signal(pthread_cond_t *cond)
+{
+    fetch_add(&cond->seq, 1);
+    sys_futex_wake(&cond->seq, 1);
+}
+
+void pthread_cond_broadcast(pthread_cond_t *cond)
+{
+    fetch_add(&cond->seq, 1);
+    sys_futex_wake(&cond->seq, INT32_MAX);
+}
+
+void pthread_barrier_init(pthread_barrier_t *barrier, int goal)
+{
+    barrier->goal = goal;
+    atomic_exchange(&barrier->count, 0);
+    atomic_exchange(&barrier->generation, 0);
+}
+
+// the last one to arrive resets the count before it opens the barrier,
+// nobody passes it before then to count in the next round
+void pthread_barrier_wait(pthread_barrier_t *barrier)
+{
+    int generation = atomic_load((volatile uint32_t *)&barrier->generation);
+
+    if (fetch_add(&barrier->count, 1) + 1 == barrier->goal) {
+        atomic_exchange(&barrier->count, 0);
+        fetch_add(&barrier->generation, 1);
+        sys_futex_wake(&barrier->generation, INT32_MAX);
+        return;
+    }
+
+    while (atomic_load((volatile uint32_t *)&barrier->generation) == generation) {
+        sys_futex_wait(&barrier->generation, generation);
+    }
+}
+
+void pthread_rwlock_init(pthread_rwlock_t *rwlock, int prefer_writer)
+{
+    rwlock->prefer_writer = prefer_writer;
+    atomic_exchange(&rwlock->state, 0);
+    atomic_exchange(&rwlock->seq, 0);
+    atomic_exchange(&rwlock->waiters, 0);
+    atomic_exchange(&rwlock->writers_waiting, 0);
+}
+
+static inline int rwlock_seq(pthread_rwlock_t *rwlock)
+{
+    return atomic_load((volatile uint32_t *)&rwlock->seq);
+}
+
+// sleep until an unlock after `seq` was read. the caller reads `seq`
+// before it looks at the rwlock, so an unlock it did not see changes
+// `seq` and the futex wait returns at once. `state` itself may be back
+// to what it was, e.g. 0 after a writer came and went. the waiter is
+// counted before the futex checks `seq`, and unlock bumps `seq` before
+// it looks for waiters, so one of the two sees the other
+static void rwlock_wait(pthread_rwlock_t *rwlock, int seq)
+{
+    fetch_add(&rwlock->waiters, 1);
+    sys_futex_wait(&rwlock->seq, seq);
+    fetch_sub(&rwlock->waiters, 1);
+}
+
+// the fast path is one lr/sc on `state`, which readers on different
+// cpus bump in turn and then run their read sections at the same time
+void pthread_rwlock_rdlock(pthread_rwlock_t *rwlock)
+{
+    while (1) {
+        int seq = rwlock_seq(rwlock);
+        int state = atomic_load((volatile uint32_t *)&rwlock->state);
+        int blocked = (state & PTHREAD_RWLOCK_WRITER) ||
+                      (rwlock->prefer_writer && rwlock->writers_waiting > 0);
+
+        if (!blocked) {
+            if (atomic_compare_exchange(&rwlock->state, state, state + 1) == state) return;
+        } else {
+            rwlock_wait(rwlock, seq);
+        }
+    }
+}
+
+void pthread_rwlock_wrlock(pthread_rwlock_t *rwlock)
+{
+    int counted = 0;
+
+    while (1) {
+        int seq = rwlock_seq(rwlock);
+        int state = atomic_load((volatile uint32_t *)&rwlock->state);
+
+        if (state == 0) {
+            if (atomic_compare_exchange(&rwlock->state, 0, PTHREAD_RWLOCK_WRITER) == 0) break;
+        } else {
+            // announced once, so a writer preferring rwlock stops new readers
+            if (!counted) {
+                fetch_add(&rwlock->writers_waiting, 1);
+                counted = 1;
+            }
+            rwlock_wait(rwlock, seq);
+        }
+    }
+    if (counted) fetch_sub(&rwlock->writers_waiting, 1);
+}
+
+// everybody asleep is woken up and races for the rwlock again, readers
+// which are held off by a waiting writer go back to sleep
+void pthread_rwlock_unlock(pthread_rwlock_t *rwlock)
+{
+    int state = atomic_load((volatile uint32_t *)&rwlock->state);
+    int left;
+
+    if (state & PTHREAD_RWLOCK_WRITER) {
+        atomic_exchange(&rwlock->state, 0);
+        left = 0;
+    } else {
+        left = fetch_sub(&rwlock->state, 1) - 1;
+    }
+
+    if (left == 0) {
+        fetch_add(&rwlock->seq, 1);
+        if (atomic_load((volatile uint32_t *)&rwlock->waiters) != 0) {
+            sys_futex_wake(&rwlock->seq, INT32_MAX);
+        }
+    }
+}
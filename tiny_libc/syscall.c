@@ -66,6 +66,11 @@ void sys_mutex_release(int mutex_idx)
     invoke_syscall(SYSCALL_LOCK_RELEASE, mutex_idx, IGNORE, IGNORE, IGNORE, IGNORE);
 }
 
+int sys_mutex_destroy(int mutex_idx)
+{
+    return invoke_syscall(SYSCALL_LOCK_DESTROY, mutex_idx, IGNORE, IGNORE, IGNORE, IGNORE);
+}
+
 long sys_get_timebase(void)
 {
     return invoke_syscall(SYSCALL_GET_TIMEBASE, IGNORE, IGNORE, IGNORE, IGNORE, IGNORE);
@@ -121,6 +126,56 @@ pid_t sys_getpid()
     return invoke_syscall(SYSCALL_GETPID, IGNORE, IGNORE, IGNORE, IGNORE, IGNORE);
 }
 
+int  sys_nice(pid_t pid, int nice)
+{
+    return invoke_syscall(SYSCALL_NICE, (long)pid, (long)nice, IGNORE, IGNORE, IGNORE);
+}
+
+int  sys_sched_deadline(pid_t pid, long runtime_us, long deadline_us, long period_us)
+{
+    return invoke_syscall(SYSCALL_SCHED_DEADLINE, (long)pid, runtime_us, deadline_us, period_us, IGNORE);
+}
+
+int  sys_taskset(pid_t pid, uint32_t mask)
+{
+    return invoke_syscall(SYSCALL_TASKSET, (long)pid, (long)mask, IGNORE, IGNORE, IGNORE);
+}
+
+pid_t sys_taskset_exec(char *name, int argc, char **argv, uint32_t mask)
+{
+    return invoke_syscall(SYSCALL_TASKSET_EXEC, (long)name, (long)argc, (long)argv, (long)mask, IGNORE);
+}
+
+int  sys_task_limit(int tasks, int threads)
+{
+    return invoke_syscall(SYSCALL_TASK_LIMIT, (long)tasks, (long)threads, IGNORE, IGNORE, IGNORE);
+}
+
+int  sys_sched_stat(cpu_stat_t *cpus, int ncpus, task_stat_t *tasks, int ntasks)
+{
+    return invoke_syscall(SYSCALL_SCHED_STAT, (long)cpus, (long)ncpus, (long)tasks, (long)ntasks, IGNORE);
+}
+
+int  sys_sched_trace(int cmd, trace_event_t *buf, int n)
+{
+    return invoke_syscall(SYSCALL_SCHED_TRACE, (long)cmd, (long)buf, (long)n, IGNORE, IGNORE);
+}
+
+int  sys_cpu_quota(int gid, long quota_us, long period_us)
+{
+    return invoke_syscall(SYSCALL_CPU_QUOTA, (long)gid, quota_us, period_us, IGNORE, IGNORE);
+}
+
+int  sys_cpu_group(int gid, pid_t pid)
+{
+    return invoke_syscall(SYSCALL_CPU_GROUP, (long)gid, (long)pid, IGNORE, IGNORE, IGNORE);
+}
+
+int  sys_sched_policy(int policy)
+{
+    return invoke_syscall(SYSCALL_SCHED_POLICY, (long)policy, IGNORE, IGNORE, IGNORE, IGNORE);
+}
+
 int  sys_getchar(void)
 {
     return invoke_syscall(SYSCALL_READCH, IGNORE, IGNORE, IGNORE, IGNORE, IGNORE);
@@ -168,7 +223,12 @@ void sys_condition_destroy(int cond_idx)
 
 int sys_mbox_open(char * name)
 {
-    return invoke_syscall(SYSCALL_MBOX_OPEN, (long)name, IGNORE, IGNORE, IGNORE, IGNORE);
+    return invoke_syscall(SYSCALL_MBOX_OPEN, (long)name, 0, IGNORE, IGNORE, IGNORE);
+}
+
+int sys_mbox_open_size(char * name, int capacity)
+{
+    return invoke_syscall(SYSCALL_MBOX_OPEN, (long)name, (long)capacity, IGNORE, IGNORE, IGNORE);
 }
 
 void sys_mbox_close(int mbox_id)
@@ -186,6 +246,16 @@ int sys_mbox_recv(int mbox_idx, void *msg, int msg_length)
     return invoke_syscall(SYSCALL_MBOX_RECV, (long)mbox_idx, (long)msg, (long)msg_length, IGNORE, IGNORE);
 }
 
+int sys_mbox_send_pages(int mbox_idx, void *addr, int npages)
+{
+    return invoke_syscall(SYSCALL_MBOX_SEND_PAGES, (long)mbox_idx, (long)addr, (long)npages, IGNORE, IGNORE);
+}
+
+int sys_mbox_recv_pages(int mbox_idx, void *addr, int npages)
+{
+    return invoke_syscall(SYSCALL_MBOX_RECV_PAGES, (long)mbox_idx, (long)addr, (long)npages, IGNORE, IGNORE);
+}
+
 void* sys_shmpageget(int key)
 {
     return (void *)invoke_syscall(SYSCALL_SHM_GET, (long)key, IGNORE, IGNORE, IGNORE, IGNORE);
@@ -196,6 +266,41 @@ void sys_shmpagedt(void *addr)
     invoke_syscall(SYSCALL_SHM_DT, (long)addr, IGNORE, IGNORE, IGNORE, IGNORE);
 }
 
+int sys_rwlock_init(int key, int flags)
+{
+    return invoke_syscall(SYSCALL_RWLOCK_INIT, (long)key, (long)flags, IGNORE, IGNORE, IGNORE);
+}
+
+void sys_rwlock_rdlock(int rw_idx)
+{
+    invoke_syscall(SYSCALL_RWLOCK_RDLOCK, (long)rw_idx, IGNORE, IGNORE, IGNORE, IGNORE);
+}
+
+void sys_rwlock_wrlock(int rw_idx)
+{
+    invoke_syscall(SYSCALL_RWLOCK_WRLOCK, (long)rw_idx, IGNORE, IGNORE, IGNORE, IGNORE);
+}
+
+void sys_rwlock_unlock(int rw_idx)
+{
+    invoke_syscall(SYSCALL_RWLOCK_UNLOCK, (long)rw_idx, IGNORE, IGNORE, IGNORE, IGNORE);
+}
+
+int sys_rwlock_destroy(int rw_idx)
+{
+    return invoke_syscall(SYSCALL_RWLOCK_DESTROY, (long)rw_idx, IGNORE, IGNORE, IGNORE, IGNORE);
+}
+
+int sys_futex_wait(volatile int *addr, int val)
+{
+    return invoke_syscall(SYSCALL_FUTEX_WAIT, (long)addr, (long)val, IGNORE, IGNORE, IGNORE);
+}
+
+int sys_futex_wake(volatile int *addr, int n)
+{
+    return invoke_syscall(SYSCALL_FUTEX_WAKE, (long)addr, (long)n, IGNORE, IGNORE, IGNORE);
+}
+
 int sys_net_send(void *txpacket, int length)
 {
     return invoke_syscall(SYSCALL_NET_SEND, (long)txpacket, (long)length, IGNORE, IGNORE, IGNORE);